@@ -1,5 +1,5 @@
 TEMPLATE = app
-QT = core gui widgets network
+QT = core gui widgets network concurrent
 CONFIG += c++2a
 INCLUDEPATH += src/ src/qtermwidget src/mapping
 OBJECTS_DIR = .build
@@ -3,11 +3,16 @@
 #include <QAbstractItemView>
 #include <QCompleter>
 #include <QKeyEvent>
-#include <QRegularExpression>
 #include <QScrollBar>
 #include <QtDebug>
 
-static QRegularExpression nonWordChars("[^[:alnum:]_-]+", QRegularExpression::UseUnicodePropertiesOption);
+static const int maxCompletions = 20;
+static const int maxWordLength = 40;
+
+static bool isWordChar(QChar ch)
+{
+  return ch.isLetterOrNumber() || ch == '_' || ch == '-';
+}
 
 QStringList CommandLine::parseMultilineCommand(const QString& command)
 {
@@ -42,6 +47,8 @@ CommandLine::CommandLine(QWidget* parent)
 {
   completer = new QCompleter(&completionModel, this);
   completer->setCaseSensitivity(Qt::CaseInsensitive);
+  // The model is already filtered and ranked
+  completer->setCompletionMode(QCompleter::UnfilteredPopupCompletion);
   completer->setWidget(this);
 
   QObject::connect(this, SIGNAL(returnPressed()), this, SLOT(onReturnPressed()));
@@ -63,16 +70,20 @@ void CommandLine::setHistorySize(int size)
 
 void CommandLine::onLineReceived(const QString& line)
 {
-  QStringList words = QString(line).replace(nonWordChars, " ").split(' ');
-  for (const QString& word : words) {
-    QString lower = word.toLower();
-    if (word.length() < 4 || knownWords.contains(lower)) {
-      continue;
+  int length = line.length();
+  int start = -1;
+  for (int i = 0; i <= length; i++) {
+    if (i < length && isWordChar(line[i])) {
+      if (start < 0) {
+        start = i;
+      }
+    } else if (start >= 0) {
+      int wordLen = i - start;
+      if (wordLen >= 4 && wordLen <= maxWordLength) {
+        completions.addWord(line.mid(start, wordLen));
+      }
+      start = -1;
     }
-    int row = completionModel.rowCount();
-    completionModel.insertRow(row);
-    completionModel.setData(completionModel.index(row, 0), word);
-    knownWords << lower;
   }
 }
 
@@ -204,8 +215,7 @@ void CommandLine::checkCompletion(int move, bool completeNow)
   int pos = cursorPosition();
   int wordStart = 0;
   for (int i = pos - 1; i >= 0; --i) {
-    QChar ch = line[i];
-    if (!ch.isLetterOrNumber() && ch != '_' && ch != '-') {
+    if (!isWordChar(line[i])) {
       wordStart = i + 1;
       break;
     }
@@ -216,8 +226,10 @@ void CommandLine::checkCompletion(int move, bool completeNow)
     return;
   }
   QString word = line.mid(wordStart, wordLen);
-  if (word != completer->completionPrefix()) {
+  if (word != completer->completionPrefix() || !completionVisible()) {
+    completionModel.setStringList(completions.complete(word, maxCompletions));
     completer->setCompletionPrefix(word);
+    completer->setCurrentRow(0);
   }
   int count = completer->completionCount();
   if (!count) {
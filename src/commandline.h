@@ -3,7 +3,7 @@
 
 #include <QLineEdit>
 #include <QStringListModel>
-#include <QSet>
+#include "completionindex.h"
 class QCompleter;
 
 class CommandLine : public QLineEdit
@@ -48,7 +48,8 @@ private:
   int historyLimit;
   int historyIndex;
 
-  QSet<QString> knownWords;
+  CompletionIndex completions;
+  // Only holds the best matches for the current prefix
   QStringListModel completionModel;
   QCompleter* completer;
   bool parsing;
@@ -2,6 +2,6 @@ CLASSES += textcommandprocessor textcommand commandresult
 CLASSES += helpcommand slotcommand identifycommand equipmentcommand
 CLASSES += mapsearchcommand zonecommand routecommand speedwalkcommand
 CLASSES += maphistorycommand simplifycommand waypointcommand
-CLASSES += customcommand sendcommand echocommand
+CLASSES += customcommand commandtemplate sendcommand echocommand
 
 addClasses()
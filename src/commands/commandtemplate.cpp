@@ -0,0 +1,117 @@
+#include "commandtemplate.h"
+
+static bool isDigit(QChar ch)
+{
+  return ch >= '0' && ch <= '9';
+}
+
+CommandTemplate::CommandTemplate(const QString& action)
+: source(action)
+{
+  int length = action.length();
+  int literalStart = 0;
+  for (int pos = 0; pos < length; pos++) {
+    // %% doesn't start a placeholder
+    if (action[pos] != '%' || (pos > 0 && action[pos - 1] == '%') || pos + 1 >= length) {
+      continue;
+    }
+    Token token{ Token::Argument, 0, QString() };
+    int end = pos + 1;
+    QChar ch = action[end];
+    if (isDigit(ch)) {
+      while (end < length && isDigit(action[end])) {
+        token.index = token.index * 10 + (action[end].cell() - '0');
+        ++end;
+      }
+    } else if (ch == '*') {
+      // Same as %1+
+      token.type = Token::Rest;
+      token.index = 1;
+      ++end;
+    } else if (ch == '{') {
+      ++end;
+      int digits = end;
+      while (end < length && isDigit(action[end])) {
+        token.index = token.index * 10 + (action[end].cell() - '0');
+        ++end;
+      }
+      if (end == digits || end >= length || action[end] != ':') {
+        continue;
+      }
+      int close = action.indexOf('}', end + 1);
+      if (close < 0 || close == end + 1) {
+        continue;
+      }
+      token.text = action.mid(end + 1, close - end - 1);
+      end = close + 1;
+    } else {
+      continue;
+    }
+    if (end < length && action[end] == '+') {
+      token.type = Token::Rest;
+      ++end;
+    }
+    token.index = qMax(token.index - 1, 0);
+
+    addLiteral(action, literalStart, pos);
+    tokens << token;
+    literalStart = end;
+    pos = end - 1;
+  }
+  addLiteral(action, literalStart, length);
+}
+
+void CommandTemplate::addLiteral(const QString& action, int start, int end)
+{
+  if (end <= start) {
+    return;
+  }
+  if (start == 0 && end == action.length()) {
+    // Share the original string when there are no placeholders
+    tokens << Token{ Token::Literal, 0, action };
+  } else {
+    tokens << Token{ Token::Literal, 0, action.mid(start, end - start) };
+  }
+  literalLength += end - start;
+}
+
+QString CommandTemplate::expand(const QStringList& args) const
+{
+  if (tokens.length() == 1 && tokens.first().type == Token::Literal) {
+    return tokens.first().text;
+  }
+
+  int argCount = args.length();
+  int length = literalLength;
+  for (const Token& token : tokens) {
+    if (token.type == Token::Literal) {
+      continue;
+    } else if (token.index >= argCount) {
+      length += token.text.length();
+    } else if (token.type == Token::Argument) {
+      length += args[token.index].length();
+    } else {
+      for (int i = token.index; i < argCount; i++) {
+        length += args[i].length() + 1;
+      }
+    }
+  }
+
+  QString result;
+  result.reserve(length);
+  for (const Token& token : tokens) {
+    if (token.type == Token::Literal || token.index >= argCount) {
+      result += token.text;
+    } else if (token.type == Token::Argument) {
+      result += args[token.index];
+    } else {
+      for (int i = token.index; i < argCount; i++) {
+        if (i > token.index) {
+          result += ' ';
+        }
+        result += args[i];
+      }
+    }
+  }
+  return result;
+}
@@ -0,0 +1,39 @@
+#ifndef GALOSH_COMMANDTEMPLATE_H
+#define GALOSH_COMMANDTEMPLATE_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// A custom command action, split into literal text and parameter
+// placeholders so it can be expanded without rescanning the text.
+class CommandTemplate
+{
+public:
+  CommandTemplate() = default;
+  CommandTemplate(const QString& action);
+
+  inline const QString& action() const { return source; }
+  QString expand(const QStringList& args) const;
+
+private:
+  struct Token {
+    enum Type {
+      Literal,
+      Argument,
+      Rest,
+    };
+    Type type;
+    int index;
+    // The literal text, or the default value of a placeholder
+    QString text;
+  };
+
+  void addLiteral(const QString& action, int start, int end);
+
+  QString source;
+  QVector<Token> tokens;
+  int literalLength = 0;
+};
+
+#endif
@@ -1,8 +1,10 @@
 #include "mapsearchcommand.h"
 #include "mapmanager.h"
+#include "explorehistory.h"
+#include <algorithm>
 
-MapSearchCommand::MapSearchCommand(MapManager* map)
-: TextCommand("SEARCH"), map(map)
+MapSearchCommand::MapSearchCommand(MapManager* map, ExploreHistory* history)
+: TextCommand("SEARCH"), map(map), history(history)
 {
   supportedKwargs["-n"] = false;
   supportedKwargs["-z"] = true;
@@ -18,7 +20,8 @@ QString MapSearchCommand::helpMessage(bool brief) const
     "Words may be regular expressions.\n"
     "Multiple words can be provided. All provided words must be found to match a room.\n"
     "Use '-n' to search only in room names.\n"
-    "Use '-z \"zone\"' to search within a single zone.";
+    "Use '-z \"zone\"' to search within a single zone.\n\n"
+    "Results are sorted by their distance from the current room.";
 }
 
 CommandResult MapSearchCommand::handleInvoke(const QStringList& args, const KWArgs& kwargs)
@@ -35,8 +38,32 @@ CommandResult MapSearchCommand::handleInvoke(const QStringList& args, const KWAr
     showError("No search results");
     return CommandResult::fail();
   }
+  const MapRoom* currentRoom = history ? history->currentRoom() : nullptr;
+  std::shared_ptr<MapSearch> search = map->search();
+  if (!currentRoom || !search) {
+    // Without a current room or routing data there's nothing to sort by
+    for (const MapRoom* room : results) {
+      showMessage(QStringLiteral("[%1] %2 (%3)").arg(room->id).arg(room->name).arg(room->zone));
+    }
+    return CommandResult::success();
+  }
+  QSet<int> roomIds;
+  for (const MapRoom* room : results) {
+    roomIds << room->id;
+  }
+  QHash<int, int> costs = search->findDistances(currentRoom->id, roomIds, map->routeAvoidZones());
+  std::stable_sort(results.begin(), results.end(), [&costs](const MapRoom* lhs, const MapRoom* rhs) {
+    auto lhsCost = costs.constFind(lhs->id);
+    auto rhsCost = costs.constFind(rhs->id);
+    if (rhsCost == costs.constEnd()) {
+      return lhsCost != costs.constEnd();
+    }
+    return lhsCost != costs.constEnd() && *lhsCost < *rhsCost;
+  });
   for (const MapRoom* room : results) {
-    showMessage(QStringLiteral("[%1] %2 (%3)").arg(room->id).arg(room->name).arg(room->zone));
+    auto cost = costs.constFind(room->id);
+    QString distance = cost == costs.constEnd() ? QStringLiteral("unreachable") : QStringLiteral("distance %1").arg(*cost);
+    showMessage(QStringLiteral("[%1] %2 (%3) - %4").arg(room->id).arg(room->name).arg(room->zone).arg(distance));
   }
   return CommandResult::success();
 }
@@ -3,11 +3,12 @@
 
 #include "textcommand.h"
 class MapManager;
+class ExploreHistory;
 
 class MapSearchCommand : public TextCommand
 {
 public:
-  MapSearchCommand(MapManager* map);
+  MapSearchCommand(MapManager* map, ExploreHistory* history = nullptr);
 
   virtual QString helpMessage(bool brief) const override;
 
@@ -17,6 +18,7 @@ protected:
 
 private:
   MapManager* map;
+  ExploreHistory* history;
 };
 
 #endif
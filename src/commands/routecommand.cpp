@@ -1,6 +1,17 @@
 #include "routecommand.h"
 #include "mapmanager.h"
 #include "explorehistory.h"
+#include "algorithms.h"
+#include <algorithm>
+
+static QSet<int> targetIds(const QMap<int, QString>& targets)
+{
+  QSet<int> roomIds;
+  for (int roomId : keys(targets)) {
+    roomIds << roomId;
+  }
+  return roomIds;
+}
 
 RouteCommand::RouteCommand(MapManager* map, ExploreHistory* history)
 : TextCommand("ROUTE"), map(map), history(history)
@@ -9,6 +20,11 @@ RouteCommand::RouteCommand(MapManager* map, ExploreHistory* history)
   supportedKwargs["-g"] = false;
   supportedKwargs["-z"] = false;
   supportedKwargs["-f"] = false;
+  supportedKwargs["-t"] = false;
+  supportedKwargs["-n"] = false;
+  supportedKwargs["-w"] = false;
+  supportedKwargs["-d"] = false;
+  supportedKwargs["-u"] = false;
 }
 
 QString RouteCommand::helpMessage(bool brief) const
@@ -17,15 +33,21 @@ QString RouteCommand::helpMessage(bool brief) const
     return "Calculates the path to a specified room";
   }
   // TODO: better docs
-  return "/ROUTE [-q] [-g] [-z] [start] <id|waypoint>\n"
+  return "/ROUTE [-q] [-g] [-u] [-z|-t|-n|-w] [-d] [start] <id|waypoint|pattern>\n"
     "Calculates a route to the specified room or waypoint and shows the steps to reach it.\n"
     "    -z        Routes to a zone instead of a room or waypoint\n"
+    "    -t        Routes to the nearest room with a room type matching the pattern\n"
+    "    -n        Routes to the nearest room with a name matching the pattern\n"
+    "    -w        Routes to the nearest waypoint with a name matching the pattern\n"
+    "    -d        Lists the distance to every match instead of routing (default: waypoints)\n"
+    "    -u        Ignores room costs, i.e. for flying\n"
     "    -q        Show as a speedwalking path\n"
     "    -g        Immediately run the speedwalking path\n"
     "    -f        Immediately run the speedwalking path in fast mode\n"
     "    start     (Optional) The room ID to start routing from\n"
     "    id        The room ID to route to\n"
-    "    waypoint  A predefined waypoint to route to";
+    "    waypoint  A predefined waypoint to route to\n"
+    "    pattern   A regular expression to match against room types, room names, or waypoints";
 }
 
 CommandResult RouteCommand::handleInvoke(const QStringList& args, const KWArgs& kwargs)
@@ -47,10 +69,34 @@ CommandResult RouteCommand::handleInvoke(const QStringList& args, const KWArgs&
     }
     startRoomId = history->currentRoom()->id;
   }
-  map->search()->precompute(false);
+  std::shared_ptr<MapSearch> search = map->search();
+  if (!search) {
+    showError("Routing data is still being built. Try again in a moment.");
+    return CommandResult::fail();
+  }
+  MapSearch::CostModel model = kwargs.contains("-u") ? MapSearch::UniformCost : MapSearch::TerrainCost;
   QList<int> route;
   QString destName;
-  if (kwargs.contains("-z")) {
+  bool multiTarget = kwargs.contains("-t") || kwargs.contains("-n") || kwargs.contains("-w") || kwargs.contains("-d");
+  if (multiTarget) {
+    QMap<int, QString> targets = findTargets(args.last(), kwargs);
+    if (targets.isEmpty()) {
+      showError("Could not find any matching rooms");
+      return CommandResult::fail();
+    }
+    if (kwargs.contains("-d")) {
+      return showDistances(search.get(), startRoomId, targets, model);
+    }
+    route = search->findNearest(startRoomId, targetIds(targets), map->routeAvoidZones(), model);
+    destName = args.last();
+    if (route.length() == 1) {
+      showError(QStringLiteral("Already at %1").arg(targets.value(startRoomId)));
+      return CommandResult::fail();
+    }
+    if (!route.isEmpty()) {
+      showMessage(QStringLiteral("Nearest match: [%1] %2").arg(route.last()).arg(targets.value(route.last())));
+    }
+  } else if (kwargs.contains("-z")) {
     const MapZone* zone = map->searchForZone(args.last());
     if (!zone) {
       showError("Could not find destination zone.");
@@ -61,7 +107,7 @@ CommandResult RouteCommand::handleInvoke(const QStringList& args, const KWArgs&
       return CommandResult::fail();
     }
     destName = zone->name;
-    route = map->search()->findRoute(startRoomId, destName, map->routeAvoidZones());
+    route = search->findRoute(startRoomId, destName, map->routeAvoidZones(), model);
   } else {
     int endRoomId = args.last().toInt();
     if (endRoomId) {
@@ -79,13 +125,13 @@ CommandResult RouteCommand::handleInvoke(const QStringList& args, const KWArgs&
       showError("Start room and destination room are the same");
       return CommandResult::fail();
     }
-    route = map->search()->findRoute(startRoomId, endRoomId, map->routeAvoidZones());
+    route = search->findRoute(startRoomId, endRoomId, map->routeAvoidZones(), model);
   }
   if (route.isEmpty()) {
     showError(QStringLiteral("Could not find route from %1 to %2").arg(startRoomId).arg(destName));
     return CommandResult::fail();
   }
-  QStringList dirs = map->search()->routeDirections(route);
+  QStringList dirs = search->routeDirections(route);
   if (dirs.isEmpty()) {
     showError(QStringLiteral("Could not find route from %1 to %2").arg(startRoomId).arg(destName));
     return CommandResult::fail();
@@ -114,7 +160,7 @@ CommandResult RouteCommand::handleInvoke(const QStringList& args, const KWArgs&
       if (fast) {
         walkArgs << "-f";
       } else {
-        walkArgs << "-v";
+        walkArgs << "-v" << "-r";
       }
       return invokeCommand("\x01SPEEDWALK", walkArgs);
     }
@@ -124,3 +170,50 @@ CommandResult RouteCommand::handleInvoke(const QStringList& args, const KWArgs&
   }
   return CommandResult::success();
 }
+
+QMap<int, QString> RouteCommand::findTargets(const QString& pattern, const KWArgs& kwargs) const
+{
+  QMap<int, QString> targets;
+  if (kwargs.contains("-t")) {
+    for (const MapRoom* room : map->searchForRoomType(pattern)) {
+      targets[room->id] = QStringLiteral("%1 (%2)").arg(room->name).arg(room->roomType);
+    }
+  } else if (kwargs.contains("-n")) {
+    for (const MapRoom* room : map->searchForRooms({ pattern }, true)) {
+      targets[room->id] = room->name;
+    }
+  } else {
+    QRegularExpression re(pattern, QRegularExpression::CaseInsensitiveOption);
+    for (const QString& name : map->waypoints()) {
+      if (re.match(name).hasMatch()) {
+        int roomId = map->waypoint(name);
+        if (map->room(roomId)) {
+          targets[roomId] = name;
+        }
+      }
+    }
+  }
+  return targets;
+}
+
+CommandResult RouteCommand::showDistances(const MapSearch* search, int startRoomId, const QMap<int, QString>& targets, MapSearch::CostModel model)
+{
+  QHash<int, int> costs = search->findDistances(startRoomId, targetIds(targets), map->routeAvoidZones(), model);
+  QList<int> roomIds = targets.keys();
+  std::stable_sort(roomIds.begin(), roomIds.end(), [&costs](int lhs, int rhs) {
+    auto lhsCost = costs.constFind(lhs);
+    auto rhsCost = costs.constFind(rhs);
+    if (rhsCost == costs.constEnd()) {
+      return lhsCost != costs.constEnd();
+    }
+    return lhsCost != costs.constEnd() && *lhsCost < *rhsCost;
+  });
+  QStringList messages;
+  for (int roomId : roomIds) {
+    auto iter = costs.constFind(roomId);
+    QString distance = iter == costs.constEnd() ? QStringLiteral("unreachable") : QString::number(*iter);
+    messages << QStringLiteral("[%1] %2: %3").arg(roomId).arg(targets.value(roomId)).arg(distance);
+  }
+  showMessage(messages.join("\n"));
+  return CommandResult::success();
+}
@@ -2,6 +2,7 @@
 #define GALOSH_ROUTECOMMAND_H
 
 #include "textcommand.h"
+#include "mapsearch.h"
 class MapManager;
 class ExploreHistory;
 
@@ -18,6 +19,9 @@ protected:
   virtual CommandResult handleInvoke(const QStringList& args, const KWArgs& kwargs) override;
 
 private:
+  QMap<int, QString> findTargets(const QString& pattern, const KWArgs& kwargs) const;
+  CommandResult showDistances(const MapSearch* search, int startRoomId, const QMap<int, QString>& targets, MapSearch::CostModel model);
+
   MapManager* map;
   ExploreHistory* history;
 };
@@ -57,10 +57,136 @@ struct Stepper
     }
     CommandResult sub;
     sub.setCallback(this, &Stepper::nextStep);
-    cmd->walk(step, sub, false);
+    cmd->walk({ step }, { sub }, false);
   };
 };
 
+struct Pipeline
+{
+  static const int maxReroutes = 3;
+
+  SpeedwalkCommand* cmd;
+  CommandResult result;
+  int window;
+  bool reroute;
+  QStringList path;
+  QList<int> expected;
+  QList<int> inFlight;
+  int dest;
+  int reroutes;
+  bool failed;
+
+  Pipeline(SpeedwalkCommand* cmd, CommandResult result, int window, bool reroute)
+  : cmd(cmd), result(result), window(window), reroute(reroute), dest(-1), reroutes(0), failed(false)
+  {
+    // initializers only
+  }
+
+  // Works out which room each step should arrive in
+  bool plan(int startRoomId, const QStringList& steps) {
+    QList<int> rooms;
+    const MapRoom* room = cmd->map->room(startRoomId);
+    for (const QString& step : steps) {
+      int next = room ? room->exits.value(MapRoom::normalizeDir(step)).dest : -1;
+      if (next <= 0) {
+        return false;
+      }
+      rooms << next;
+      room = cmd->map->room(next);
+    }
+    path = steps;
+    expected = rooms;
+    dest = rooms.isEmpty() ? startRoomId : rooms.last();
+    return true;
+  }
+
+  void fill() {
+    QStringList steps;
+    QList<CommandResult> subs;
+    while (inFlight.length() < window && !path.isEmpty()) {
+      steps << path.takeFirst();
+      inFlight << expected.takeFirst();
+      CommandResult sub;
+      sub.setCallback(this, &Pipeline::stepDone);
+      subs << sub;
+    }
+    if (!steps.isEmpty()) {
+      cmd->walk(steps, subs, false);
+    }
+  }
+
+  void stepDone(const CommandResult* stepResult) {
+    int expectedId = inFlight.takeFirst();
+    if (!failed) {
+      const MapRoom* room = cmd->history->currentRoom();
+      if (result.wasAborted() || stepResult->hasError()) {
+        failed = true;
+      } else if (!room || room->id != expectedId) {
+        if (!room) {
+          cmd->showError("Cannot identify current room!");
+        } else {
+          cmd->showError(QStringLiteral("Currently in room %1 instead of room %2!").arg(room->id).arg(expectedId));
+        }
+        failed = true;
+      }
+      if (failed) {
+        // Steps that were already sent can't be recalled, but nothing else goes out
+        path.clear();
+        expected.clear();
+      }
+    }
+    if (!inFlight.isEmpty()) {
+      if (!failed) {
+        fill();
+      }
+      return;
+    }
+    if (result.wasAborted()) {
+      delete this;
+      return;
+    }
+    if (failed && !rerouteFromCurrentRoom()) {
+      result.done(true);
+      delete this;
+      return;
+    }
+    if (path.isEmpty()) {
+      cmd->showMessage("Speedwalk complete.");
+      result.done(false);
+      delete this;
+      return;
+    }
+    fill();
+  }
+
+  bool rerouteFromCurrentRoom() {
+    const MapRoom* room = cmd->history->currentRoom();
+    if (!reroute || !room || reroutes >= maxReroutes) {
+      return false;
+    }
+    ++reroutes;
+    failed = false;
+    if (room->id == dest) {
+      return true;
+    }
+    auto search = cmd->map->search();
+    if (!search) {
+      cmd->showError("Routing data is still being built, so the walk can't be rerouted.");
+      return false;
+    }
+    QStringList dirs = search->routeDirections(search->findRoute(room->id, dest, cmd->map->routeAvoidZones()));
+    for (QString& dir : dirs) {
+      dir = dir.toLower();
+    }
+    if (dirs.isEmpty() || !plan(room->id, dirs)) {
+      cmd->showError(QStringLiteral("Could not find route from %1 to %2").arg(room->id).arg(dest));
+      return false;
+    }
+    cmd->showMessage(QStringLiteral("Rerouting from room %1.").arg(room->id));
+    return true;
+  }
+};
+
 QStringList SpeedwalkCommand::parseSpeedwalk(const QString& dirs)
 {
   if (dirs.isEmpty()) {
@@ -115,7 +241,7 @@ QStringList SpeedwalkCommand::parseSpeedwalk(const QString& dirs)
 }
 
 SpeedwalkCommand::SpeedwalkCommand(MapManager* map, ExploreHistory* history, WalkFn walkFn, bool quiet)
-: TextCommand("SPEEDWALK"), map(map), history(history), walk(walkFn), quiet(quiet)
+: TextCommand("SPEEDWALK"), map(map), history(history), walk(walkFn), quiet(quiet), window(1)
 {
   addKeyword("\x01SPEEDWALK");
   addKeyword("SPEED");
@@ -124,10 +250,17 @@ SpeedwalkCommand::SpeedwalkCommand(MapManager* map, ExploreHistory* history, Wal
   supportedKwargs["-v"] = false;
   supportedKwargs["-f"] = false;
   supportedKwargs["-q"] = false;
+  supportedKwargs["-p"] = true;
+  supportedKwargs["-r"] = false;
   // path is pre-parsed -- impossible to type, used by other commands
   supportedKwargs[" "] = false;
 }
 
+void SpeedwalkCommand::setWindow(int steps)
+{
+  window = qMax(steps, 1);
+}
+
 QString SpeedwalkCommand::helpMessage(bool brief) const
 {
   if (brief) {
@@ -140,6 +273,9 @@ QString SpeedwalkCommand::helpMessage(bool brief) const
     "  -x [id]  Validates that you are in the specified room ID before moving.\n"
     "           This can be used to halt custom commands that depend on location.\n\n"
     "  -f       Fast mode (incompatible with -v / -x)\n"
+    "  -p [n]   Sends up to n steps ahead of the automap (default from profile)\n"
+    "           Each room is still validated, which requires GMCP room IDs.\n"
+    "  -r       With -p, reroutes to the destination if a step goes astray\n"
     "Speedwalk path syntax:\n"
     "  any letter:  send a one-letter command to the MUD\n"
     "  numbers:     send the next command to the MUD the specified number of times\n"
@@ -156,6 +292,14 @@ CommandResult SpeedwalkCommand::handleInvoke(const QStringList& args, const KWAr
     showError("Cannot use fast mode with -v.");
     return CommandResult::fail();
   }
+  int stepWindow = window;
+  if (kwargs.contains("-p")) {
+    stepWindow = kwargs.value("-p").toInt();
+    if (stepWindow < 1) {
+      showError("Invalid window size: " + kwargs.value("-p"));
+      return CommandResult::fail();
+    }
+  }
   int validate = 0;
   if (kwargs.contains("-x")) {
     validate = kwargs.value("-x").toInt();
@@ -192,13 +336,20 @@ CommandResult SpeedwalkCommand::handleInvoke(const QStringList& args, const KWAr
   }
   if (fast) {
     CommandResult result;
-    for (const QString& step : path) {
-      walk(step, result, true);
-    }
+    walk(path, {}, true);
     result.done(false);
     return result;
   }
   CommandResult result;
+  if (stepWindow > 1 && room && map->gmcpMode && !path.isEmpty()) {
+    Pipeline* pipeline = new Pipeline(this, result, stepWindow, kwargs.contains("-r"));
+    if (pipeline->plan(room->id, path)) {
+      pipeline->fill();
+      return result;
+    }
+    // Steps that don't follow known exits can't be checked ahead of time
+    delete pipeline;
+  }
   Stepper* stepper = new Stepper(this, result, validateAll, quiet, path);
   stepper->nextStep();
   return result;
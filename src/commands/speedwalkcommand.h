@@ -11,13 +11,16 @@ class SpeedwalkCommand : public QObject, public TextCommand
 {
 Q_OBJECT
 public:
-  using WalkFn = std::function<void(const QString&, CommandResult&, bool)>;
+  using WalkFn = std::function<void(const QStringList&, const QList<CommandResult>&, bool)>;
   static QStringList parseSpeedwalk(const QString& dirs);
 
   SpeedwalkCommand(MapManager* map, ExploreHistory* history, WalkFn walkFn, bool quiet = true);
 
   virtual QString helpMessage(bool brief) const override;
 
+  // The number of steps that may be sent before the first one arrives
+  void setWindow(int steps);
+
 signals:
   void speedwalk(const QStringList& steps, bool fast);
 
@@ -27,10 +30,12 @@ protected:
 
 private:
   friend class Stepper;
+  friend class Pipeline;
   MapManager* map;
   ExploreHistory* history;
   WalkFn walk;
   bool quiet;
+  int window;
 };
 
 #endif
@@ -47,6 +47,22 @@ QPair<QString, QStringList> TextCommandProcessor::parseCommand(const QString& _c
     return { key, { command } };
   }
 
+  if (!command.contains('"') && !command.contains('\'') && !command.contains('\\')) {
+    // Nothing to unquote, so slice the arguments out directly
+    int start = -1;
+    for (int i = 0; i <= command.length(); i++) {
+      if (i == command.length() || command[i].isSpace()) {
+        if (start >= 0) {
+          args << command.mid(start, i - start);
+          start = -1;
+        }
+      } else if (start < 0) {
+        start = i;
+      }
+    }
+    return { key, args };
+  }
+
   QChar quote = '\0';
   QString token;
   bool escape = false;
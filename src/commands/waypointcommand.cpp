@@ -132,9 +132,13 @@ CommandResult WaypointCommand::handleRoute(const QString& name, bool run, bool f
     }
     return CommandResult::success();
   }
-  map->search()->precompute(false);
-  QList<int> route = map->search()->findRoute(startRoomId, endRoomId, map->routeAvoidZones());
-  QStringList dirs = route.isEmpty() ? QStringList() : map->search()->routeDirections(route);
+  std::shared_ptr<MapSearch> search = map->search();
+  if (!search) {
+    showError("Routing data is still being built. Try again in a moment.");
+    return CommandResult::fail();
+  }
+  QList<int> route = search->findRoute(startRoomId, endRoomId, map->routeAvoidZones());
+  QStringList dirs = route.isEmpty() ? QStringList() : search->routeDirections(route);
   if (dirs.isEmpty()) {
     if (run) {
       showError(QStringLiteral("Could not find route from %1 to %2.").arg(startRoomId).arg(endRoomId));
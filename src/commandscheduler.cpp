@@ -0,0 +1,130 @@
+#include "commandscheduler.h"
+#include "telnetsocket.h"
+#include <QtMath>
+
+CommandScheduler::CommandScheduler(TelnetSocket* socket, QObject* parent)
+: QObject(parent), socket(socket), rate(0), burst(1), tokens(1), lastRefill(0), latency(0), coalesce(true)
+{
+  clock.start();
+  flushTimer.setSingleShot(true);
+  QObject::connect(&flushTimer, SIGNAL(timeout()), this, SLOT(flush()));
+  QObject::connect(socket, SIGNAL(disconnected()), this, SLOT(clear()));
+}
+
+void CommandScheduler::setRateLimit(double commandsPerSecond, int burstSize)
+{
+  refill();
+  rate = qMax(commandsPerSecond, 0.0);
+  burst = qMax(burstSize, 1);
+  tokens = qMin(tokens, double(burst));
+  if (queueDepth() && !flushTimer.isActive()) {
+    flushTimer.start(0);
+  }
+}
+
+void CommandScheduler::setCoalescing(bool on)
+{
+  coalesce = on;
+}
+
+void CommandScheduler::enqueue(const QByteArray& command, Lane lane)
+{
+  if (!socket->isConnected()) {
+    // Nothing queued can be sent once the connection is gone
+    return;
+  }
+  if (rate <= 0 && !coalesce && !queueDepth()) {
+    // Nothing to pace or batch with, so don't wait for the event loop
+    socket->write(command + "\r\n");
+    emit commandsSent(lane);
+    latency *= 0.8;
+    return;
+  }
+  lanes[lane].enqueue(qMakePair(command, clock.elapsed()));
+  if (!flushTimer.isActive()) {
+    // Wait for the event loop so commands issued together share a write
+    flushTimer.start(0);
+  }
+  emit queueChanged(queueDepth());
+}
+
+void CommandScheduler::clear()
+{
+  flushTimer.stop();
+  for (auto& lane : lanes) {
+    lane.clear();
+  }
+  emit queueChanged(0);
+}
+
+int CommandScheduler::queueDepth() const
+{
+  int depth = 0;
+  for (const auto& lane : lanes) {
+    depth += lane.length();
+  }
+  return depth;
+}
+
+int CommandScheduler::queueDepth(Lane lane) const
+{
+  return lanes[lane].length();
+}
+
+int CommandScheduler::sendLatency() const
+{
+  return qRound(latency);
+}
+
+void CommandScheduler::refill()
+{
+  qint64 now = clock.elapsed();
+  if (rate > 0) {
+    tokens = qMin(tokens + (now - lastRefill) * rate / 1000.0, double(burst));
+  }
+  lastRefill = now;
+}
+
+void CommandScheduler::flush()
+{
+  if (!socket->isConnected()) {
+    // Don't count commands that were never sent against the rate or the latency
+    clear();
+    return;
+  }
+  refill();
+  QList<QByteArray> payloads;
+  QList<int> sentLanes;
+  qint64 now = clock.elapsed();
+  for (int index = 0; index < LaneCount; index++) {
+    auto& lane = lanes[index];
+    while (!lane.isEmpty() && (rate <= 0 || tokens >= 1)) {
+      QPair<QByteArray, qint64> entry = lane.dequeue();
+      if (sentLanes.isEmpty() || sentLanes.last() != index) {
+        sentLanes << index;
+      }
+      if (coalesce && !payloads.isEmpty()) {
+        payloads.last() += entry.first + "\r\n";
+      } else {
+        payloads << entry.first + "\r\n";
+      }
+      latency = latency * 0.8 + (now - entry.second) * 0.2;
+      if (rate > 0) {
+        tokens -= 1;
+      }
+    }
+  }
+  if (!payloads.isEmpty()) {
+    for (const QByteArray& payload : payloads) {
+      socket->write(payload);
+    }
+    for (int lane : sentLanes) {
+      emit commandsSent(lane);
+    }
+    emit queueChanged(queueDepth());
+  }
+  if (queueDepth()) {
+    // Come back when the next token is available
+    flushTimer.start(qCeil((1 - tokens) * 1000 / rate));
+  }
+}
@@ -0,0 +1,66 @@
+#ifndef GALOSH_COMMANDSCHEDULER_H
+#define GALOSH_COMMANDSCHEDULER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QQueue>
+#include <QPair>
+class TelnetSocket;
+
+// Paces outgoing commands with a token bucket so bursts don't get the
+// connection flood-kicked. Commands that are ready in the same pass are
+// sent in a single write.
+class CommandScheduler : public QObject
+{
+Q_OBJECT
+public:
+  enum Lane {
+    Interactive,
+    Triggered,
+    Bulk,
+    LaneCount,
+  };
+
+  CommandScheduler(TelnetSocket* socket, QObject* parent = nullptr);
+
+  // A rate of 0 disables pacing. Unless coalescing is off, commands still wait
+  // one pass of the event loop so that commands issued together share a write.
+  void setRateLimit(double commandsPerSecond, int burst);
+  void setCoalescing(bool on);
+
+  void enqueue(const QByteArray& command, Lane lane = Interactive);
+
+  int queueDepth() const;
+  int queueDepth(Lane lane) const;
+  // Moving average of the time commands spend in the queue, in milliseconds
+  int sendLatency() const;
+
+public slots:
+  // Drops every queued command. Called when the connection closes.
+  void clear();
+
+signals:
+  void queueChanged(int depth);
+  // Commands from the lane were written to the socket
+  void commandsSent(int lane);
+
+private slots:
+  void flush();
+
+private:
+  void refill();
+
+  TelnetSocket* socket;
+  QQueue<QPair<QByteArray, qint64>> lanes[LaneCount];
+  QTimer flushTimer;
+  QElapsedTimer clock;
+  double rate;
+  int burst;
+  double tokens;
+  qint64 lastRefill;
+  double latency;
+  bool coalesce;
+};
+
+#endif
@@ -0,0 +1,200 @@
+#include "completionindex.h"
+#include <algorithm>
+#include <cmath>
+
+// A word's score halves after this many other words have been seen
+static const double recencyHalfLife = 10000;
+
+CompletionIndex::CompletionIndex(int capacity)
+: capacity(qMax(capacity, 1))
+{
+  clear();
+}
+
+void CompletionIndex::setCapacity(int words)
+{
+  capacity = qMax(words, 1);
+  while (size() > capacity) {
+    evict();
+  }
+}
+
+void CompletionIndex::clear()
+{
+  nodes.clear();
+  freeNodes.clear();
+  entries.clear();
+  freeEntries.clear();
+  nodes << (Node){ QChar(), -1, -1, -1, -1 };
+  oldest = -1;
+  newest = -1;
+  tick = 0;
+}
+
+void CompletionIndex::addWord(const QString& word)
+{
+  QString key = word.toLower();
+  ++tick;
+  int node = findNode(key);
+  if (node >= 0 && nodes[node].entry >= 0) {
+    Entry& entry = entries[nodes[node].entry];
+    entry.count++;
+    entry.lastSeen = tick;
+    unlink(nodes[node].entry);
+    link(nodes[node].entry);
+    return;
+  }
+
+  // Evict before building the path so pruning can't remove it
+  if (size() >= capacity) {
+    evict();
+  }
+  node = 0;
+  for (QChar ch : key) {
+    int next = findChild(node, ch);
+    node = next < 0 ? addChild(node, ch) : next;
+  }
+  int entryId;
+  Entry entry{ word, node, 1, tick, -1, -1 };
+  if (freeEntries.isEmpty()) {
+    entryId = entries.size();
+    entries << entry;
+  } else {
+    entryId = freeEntries.takeLast();
+    entries[entryId] = entry;
+  }
+  nodes[node].entry = entryId;
+  link(entryId);
+}
+
+QStringList CompletionIndex::complete(const QString& prefix, int limit) const
+{
+  int start = findNode(prefix.toLower());
+  if (start < 0 || limit <= 0) {
+    return {};
+  }
+
+  QVector<QPair<double, int>> matches;
+  QVector<int> stack{ start };
+  while (!stack.isEmpty()) {
+    int node = stack.takeLast();
+    if (nodes[node].entry >= 0) {
+      matches << qMakePair(score(entries[nodes[node].entry]), nodes[node].entry);
+    }
+    for (int child = nodes[node].child; child >= 0; child = nodes[child].sibling) {
+      stack << child;
+    }
+  }
+
+  auto end = matches.begin() + qMin(limit, matches.size());
+  std::partial_sort(matches.begin(), end, matches.end(), [](const QPair<double, int>& lhs, const QPair<double, int>& rhs) {
+    return lhs.first > rhs.first;
+  });
+  QStringList words;
+  for (auto iter = matches.begin(); iter != end; ++iter) {
+    words << entries[iter->second].word;
+  }
+  return words;
+}
+
+double CompletionIndex::score(const Entry& entry) const
+{
+  return entry.count * std::exp2(-double(tick - entry.lastSeen) / recencyHalfLife);
+}
+
+int CompletionIndex::findNode(const QString& key) const
+{
+  int node = 0;
+  for (QChar ch : key) {
+    node = findChild(node, ch);
+    if (node < 0) {
+      return -1;
+    }
+  }
+  return node;
+}
+
+int CompletionIndex::findChild(int node, QChar ch) const
+{
+  for (int child = nodes[node].child; child >= 0; child = nodes[child].sibling) {
+    if (nodes[child].ch == ch) {
+      return child;
+    }
+  }
+  return -1;
+}
+
+int CompletionIndex::addChild(int node, QChar ch)
+{
+  Node child{ ch, node, -1, nodes[node].child, -1 };
+  int childId;
+  if (freeNodes.isEmpty()) {
+    childId = nodes.size();
+    nodes << child;
+  } else {
+    childId = freeNodes.takeLast();
+    nodes[childId] = child;
+  }
+  nodes[node].child = childId;
+  return childId;
+}
+
+void CompletionIndex::prune(int node)
+{
+  while (node > 0 && nodes[node].entry < 0 && nodes[node].child < 0) {
+    int parent = nodes[node].parent;
+    if (nodes[parent].child == node) {
+      nodes[parent].child = nodes[node].sibling;
+    } else {
+      int prev = nodes[parent].child;
+      while (nodes[prev].sibling != node) {
+        prev = nodes[prev].sibling;
+      }
+      nodes[prev].sibling = nodes[node].sibling;
+    }
+    freeNodes << node;
+    node = parent;
+  }
+}
+
+void CompletionIndex::unlink(int entryId)
+{
+  Entry& entry = entries[entryId];
+  if (entry.older >= 0) {
+    entries[entry.older].newer = entry.newer;
+  } else {
+    oldest = entry.newer;
+  }
+  if (entry.newer >= 0) {
+    entries[entry.newer].older = entry.older;
+  } else {
+    newest = entry.older;
+  }
+  entry.older = entry.newer = -1;
+}
+
+void CompletionIndex::link(int entryId)
+{
+  entries[entryId].older = newest;
+  entries[entryId].newer = -1;
+  if (newest >= 0) {
+    entries[newest].newer = entryId;
+  } else {
+    oldest = entryId;
+  }
+  newest = entryId;
+}
+
+void CompletionIndex::evict()
+{
+  int entryId = oldest;
+  if (entryId < 0) {
+    return;
+  }
+  unlink(entryId);
+  Entry& entry = entries[entryId];
+  nodes[entry.node].entry = -1;
+  prune(entry.node);
+  entry.word.clear();
+  freeEntries << entryId;
+}
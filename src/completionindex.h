@@ -0,0 +1,62 @@
+#ifndef GALOSH_COMPLETIONINDEX_H
+#define GALOSH_COMPLETIONINDEX_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// Case-insensitive prefix index of words seen during a session. Words are
+// ranked by how often and how recently they were seen, and the least
+// recently seen words are dropped once the index is full.
+class CompletionIndex
+{
+public:
+  CompletionIndex(int capacity = 20000);
+
+  inline int size() const { return entries.size() - freeEntries.size(); }
+  void setCapacity(int words);
+  void clear();
+
+  void addWord(const QString& word);
+  QStringList complete(const QString& prefix, int limit) const;
+
+private:
+  // Tries are stored as first-child / next-sibling links into a node pool
+  struct Node {
+    QChar ch;
+    int parent;
+    int child;
+    int sibling;
+    int entry;
+  };
+
+  struct Entry {
+    QString word;
+    int node;
+    quint32 count;
+    quint64 lastSeen;
+    // Recency list, oldest first
+    int older;
+    int newer;
+  };
+
+  int findNode(const QString& key) const;
+  int findChild(int node, QChar ch) const;
+  int addChild(int node, QChar ch);
+  void prune(int node);
+  void unlink(int entry);
+  void link(int entry);
+  void evict();
+  double score(const Entry& entry) const;
+
+  QVector<Node> nodes;
+  QVector<int> freeNodes;
+  QVector<Entry> entries;
+  QVector<int> freeEntries;
+  int oldest;
+  int newest;
+  int capacity;
+  quint64 tick;
+};
+
+#endif
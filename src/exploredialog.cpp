@@ -126,7 +126,7 @@ ExploreDialog::ExploreDialog(GaloshSession* session, int roomId, int lastRoomId,
 
   line->setFocus();
 
-  addCommand(new MapSearchCommand(map));
+  addCommand(new MapSearchCommand(map, &history));
   addCommand(new ZoneCommand(map));
   addCommand(new MapHistoryCommand("HISTORY", &history));
   addCommand(new MapHistoryCommand("REVERSE", &history));
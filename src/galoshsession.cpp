@@ -23,7 +23,8 @@
 #include <QSettings>
 
 GaloshSession::GaloshSession(UserProfile* profile, QWidget* parent)
-: QObject(parent), TextCommandProcessor("/"), profile(profile), autoMap(map()), exploreHistory(map()), unread(false)
+: QObject(parent), TextCommandProcessor("/"), profile(profile), autoMap(map(), &exploreHistory), exploreHistory(map()), unread(false),
+  sendLane(CommandScheduler::Interactive)
 {
   term = new GaloshTerm(parent);
   QObject::connect(term, SIGNAL(lineReceived(QString)), &autoMap, SLOT(processLine(QString)));
@@ -42,6 +43,8 @@ GaloshSession::GaloshSession(UserProfile* profile, QWidget* parent)
   QObject::connect(term->socket(), SIGNAL(msspEvent(QString, QString)), this, SIGNAL(msspReceived()));
   QObject::connect(term->socket(), SIGNAL(gmcpEvent(QString, QVariant)), &autoMap, SLOT(gmcpEvent(QString, QVariant)));
   QObject::connect(term->socket(), SIGNAL(gmcpEvent(QString, QVariant)), this, SLOT(gmcpEvent(QString, QVariant)));
+  QObject::connect(term->scheduler(), SIGNAL(queueChanged(int)), this, SIGNAL(statusUpdated()));
+  QObject::connect(term->scheduler(), SIGNAL(commandsSent(int)), this, SLOT(commandsSent(int)));
   QObject::connect(term->socket(), SIGNAL(serverCertificate(QMap<QString,QString>,bool,bool)), this, SLOT(serverCertificate(QMap<QString,QString>,bool,bool)));
 
   infoModel = new InfoModel(this);
@@ -50,7 +53,7 @@ GaloshSession::GaloshSession(UserProfile* profile, QWidget* parent)
   addCommand(new IdentifyCommand(&profile->serverProfile->itemDB));
   addCommand(new EchoCommand(triggers()));
   addCommand(new EquipmentCommand(this));
-  addCommand(new SpeedwalkCommand(map(), &exploreHistory, [this](const QString& step, CommandResult& res, bool fast){ speedwalkStep(step, res, fast); }, false));
+  speedwalk = addCommand(new SpeedwalkCommand(map(), &exploreHistory, [this](const QStringList& steps, const QList<CommandResult>& results, bool fast){ speedwalkSteps(steps, results, fast); }, false));
   addCommand(new SlotCommand("DC", term->socket(), SLOT(disconnectFromHost()), "Disconnects from the game"))->addKeyword("DISCONNECT");
   addCommand(new SlotCommand("EXPLORE", this, SLOT(exploreMap()), "Opens the map exploration window"))->addKeyword("MAP");
   addCommand(new RouteCommand(map(), &exploreHistory));
@@ -61,8 +64,10 @@ GaloshSession::GaloshSession(UserProfile* profile, QWidget* parent)
   QObject::connect(&autoMap, SIGNAL(currentRoomUpdated(int)), this, SLOT(setLastRoom(int)));
 
   term->installEventFilter(this);
+  if (!itemDB()->lastLoadError().isEmpty()) {
+    term->showError(itemDB()->lastLoadError());
+  }
   equipResult = CommandResult::success();
-  stepResult = CommandResult::success();
   customResult = CommandResult::success();
   stepTimer.setInterval(3000);
   stepTimer.setSingleShot(true);
@@ -129,10 +134,12 @@ QString GaloshSession::statusBarText() const
   if (host.isEmpty()) {
     return "Disconnected.";
   }
-  if (statusBar.isEmpty()) {
-    return QStringLiteral("Connected to %1.").arg(host);
+  QString text = statusBar.isEmpty() ? QStringLiteral("Connected to %1.").arg(host) : statusBar;
+  int queued = term->scheduler()->queueDepth();
+  if (queued) {
+    text += QStringLiteral(" (%1 queued, %2 ms delay)").arg(queued).arg(term->scheduler()->sendLatency());
   }
-  return statusBar;
+  return text;
 }
 
 void GaloshSession::connect()
@@ -164,6 +171,10 @@ void GaloshSession::reload()
   QString colors = profile->colorScheme.isEmpty() ? ColorSchemes::defaultScheme() : profile->colorScheme;
   term->setColorScheme(ColorSchemes::scheme(colors));
   term->setTermFont(profile->font());
+  speedwalk->setWindow(profile->speedwalkWindow);
+  ServerProfile* server = profile->serverProfile;
+  term->scheduler()->setRateLimit(server->commandRate, server->commandBurst);
+  term->scheduler()->setCoalescing(server->batchCommands);
 }
 
 void GaloshSession::serverCertificate(const QMap<QString, QString>& info, bool selfSigned, bool nameMismatch)
@@ -232,10 +243,7 @@ void GaloshSession::setLastRoom(int roomId)
   profile->setLastRoomId(roomId);
   exploreHistory.goTo(roomId);
   emit currentRoomUpdated();
-  stepTimer.stop();
-  if (!stepResult.isFinished()) {
-    stepResult.done(false);
-  }
+  finishStep(false);
 }
 
 void GaloshSession::showCommandMessage(TextCommand* command, const QString& message, TextCommandProcessor::MessageType msgType)
@@ -279,11 +287,11 @@ void GaloshSession::exploreMap(int roomId, const QString& movement)
 void GaloshSession::onLineReceived(const QString& line)
 {
   setUnread();
-  if (!stepResult.isFinished()) {
+  if (!stepResults.isEmpty()) {
     // TODO: make triggers configurable
     if (line.contains("Alas, you cannot go that way") || line.endsWith("seems to be closed.")) {
       term->showError("Speedwalking failed.");
-      stepResult.done(true);
+      finishStep(true);
     }
   }
 }
@@ -461,6 +469,7 @@ void GaloshSession::changeEquipment(const ItemDatabase::EquipmentSet& _current,
     }
   }
 
+  sendLane = CommandScheduler::Triggered;
   for (auto [slot, remove, equip] : actions) {
     if (!remove.isEmpty()) {
       term->processCommand(QStringLiteral("remove %1").arg(remove));
@@ -501,6 +510,7 @@ void GaloshSession::changeEquipment(const ItemDatabase::EquipmentSet& _current,
       break;
     }
   }
+  sendLane = CommandScheduler::Interactive;
 
   equipResult.done(false);
 }
@@ -539,12 +549,22 @@ void GaloshSession::connectionChanged()
   if (itemSets) {
     itemSets->setConnected(conn);
   }
+  if (!conn) {
+    // The scheduler dropped anything still queued, so nothing in flight will complete
+    if (!stepResults.isEmpty()) {
+      abortSteps("Disconnected while speedwalking.");
+    }
+    if (!equipResult.isFinished()) {
+      equipResult.done(true);
+    }
+  }
 }
 
 bool GaloshSession::commandFilter(const QString& command, const QStringList& args)
 {
   if (command.isEmpty()) {
-    term->transmitCommand(args.join(' '));
+    // Queued lines come from triggers and custom commands
+    term->transmitCommand(args.join(' '), true, CommandScheduler::Triggered);
     return true;
   }
   if (command == ".") {
@@ -563,27 +583,67 @@ bool GaloshSession::commandFilter(const QString& command, const QStringList& arg
 
 void GaloshSession::stepTimeout()
 {
-  if (stepResult.isFinished()) {
+  if (stepResults.isEmpty()) {
     return;
   }
-  term->showError("Speedwalking appears to have stalled. Aborting.");
-  if (!stepResult.isFinished()) {
-    stepResult.done(true);
+  abortSteps("Speedwalking appears to have stalled. Aborting.");
+}
+
+void GaloshSession::abortSteps(const QString& message)
+{
+  term->showError(message);
+  // Nothing else is going to arrive, so fail every step still in flight
+  for (int i = stepResults.length(); i > 0 && !stepResults.isEmpty(); --i) {
+    finishStep(true);
+  }
+}
+
+void GaloshSession::commandsSent(int lane)
+{
+  if (lane == CommandScheduler::Bulk && !stepResults.isEmpty()) {
+    stepTimer.start();
   }
 }
 
-void GaloshSession::speedwalkStep(const QString& step, CommandResult& res, bool fast)
+void GaloshSession::finishStep(bool error)
 {
+  if (stepResults.isEmpty()) {
+    stepTimer.stop();
+    return;
+  }
+  CommandResult res = stepResults.takeFirst();
+  if (stepResults.isEmpty() || term->scheduler()->queueDepth(CommandScheduler::Bulk)) {
+    // Steps still waiting in the scheduler restart the timer when they're sent
+    stepTimer.stop();
+  } else {
+    stepTimer.start();
+  }
+  if (!res.isFinished()) {
+    res.done(error);
+  }
+}
+
+void GaloshSession::speedwalkSteps(const QStringList& steps, const QList<CommandResult>& results, bool fast)
+{
+  if (steps.isEmpty()) {
+    return;
+  }
   if (!term->socket()->isConnected()) {
     term->showError("Cannot speedwalk while offline.");
-    res.done(true);
+    for (CommandResult res : results) {
+      res.done(true);
+    }
     return;
   }
   if (!fast) {
-    stepResult = res;
-    stepTimer.start();
+    // The timer starts when the scheduler sends the steps, not while they wait behind other commands
+    stepResults += results;
+  }
+  sendLane = CommandScheduler::Bulk;
+  for (const QString& step : steps) {
+    term->processCommand(step);
   }
-  term->processCommand(step);
+  sendLane = CommandScheduler::Interactive;
 }
 
 bool GaloshSession::isCustomCommand(const QString& command) const
@@ -594,12 +654,12 @@ bool GaloshSession::isCustomCommand(const QString& command) const
 void GaloshSession::processCommand(const QString& command, bool echo)
 {
   if (!echo || !term->isParsing()) {
-    term->transmitCommand(command, echo);
+    term->transmitCommand(command, echo, sendLane);
     return;
   }
   auto [cmd, args] = parseCommand(command);
   if (cmd.isEmpty()) {
-    term->transmitCommand(command, true);
+    term->transmitCommand(command, true, sendLane);
   } else if (cmd == ".") {
     if (!abortQueue()) {
       term->showError("Nothing to abort.");
@@ -614,7 +674,7 @@ void GaloshSession::processCommand(const QString& command, bool echo)
 void GaloshSession::processTrigger(const QString& command, bool echo)
 {
   if (!echo) {
-    term->transmitCommand(command, false);
+    term->transmitCommand(command, false, CommandScheduler::Triggered);
     return;
   }
   QStringList lines = CommandLine::parseMultilineCommand(command);
@@ -635,7 +695,7 @@ void GaloshSession::processCommands(const QStringList& commands)
   }
   if (immediate) {
     for (const QString& line : commands) {
-      term->transmitCommand(line, true);
+      term->transmitCommand(line, true, sendLane);
     }
   } else if (isRunning()) {
     term->showError("Another command is already in progress.");
@@ -18,6 +18,7 @@ class InfoModel;
 class ExploreDialog;
 class ItemSearchDialog;
 class ItemSetDialog;
+class SpeedwalkCommand;
 
 class GaloshSession : public QObject, public TextCommandProcessor
 {
@@ -84,9 +85,12 @@ private slots:
   void serverCertificate(const QMap<QString, QString>& info, bool selfSigned, bool nameMismatch);
   void connectionChanged();
   void stepTimeout();
+  void commandsSent(int lane);
 
 private:
-  void speedwalkStep(const QString& step, CommandResult& res, bool fast);
+  void speedwalkSteps(const QStringList& steps, const QList<CommandResult>& results, bool fast);
+  void finishStep(bool error);
+  void abortSteps(const QString& message);
   void changeEquipment(const ItemDatabase::EquipmentSet& current, const QString& setName, const QString& container);
 
   AutoMapper autoMap;
@@ -96,8 +100,12 @@ private:
   QPointer<ItemSearchDialog> itemSearch;
   QPointer<ItemSetDialog> itemSets;
   bool unread;
-  CommandResult equipResult, stepResult, customResult;
+  CommandScheduler::Lane sendLane;
+  CommandResult equipResult, customResult;
+  // Speedwalk steps that have been sent but haven't arrived yet
+  QList<CommandResult> stepResults;
   QTimer stepTimer;
+  SpeedwalkCommand* speedwalk;
 };
 
 #endif
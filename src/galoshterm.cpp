@@ -27,6 +27,7 @@ GaloshTerm::GaloshTerm(QWidget* parent)
 : QWidget(parent), pendingScroll(false)
 {
   tel = new TelnetSocket(this);
+  outgoing = new CommandScheduler(tel, this);
   QObject::connect(tel, SIGNAL(echoChanged(bool)), this, SLOT(onEchoChanged(bool)));
   QObject::connect(tel, SIGNAL(connected()), this, SLOT(onConnected()));
   QObject::connect(tel, SIGNAL(disconnected()), this, SLOT(onDisconnected()));
@@ -172,12 +173,12 @@ void GaloshTerm::processCommand(const QString& command, bool echo)
   line->processCommand(command, echo);
 }
 
-void GaloshTerm::transmitCommand(const QString& command, bool echo)
+void GaloshTerm::transmitCommand(const QString& command, bool echo, CommandScheduler::Lane lane)
 {
   QByteArray payload = command.toUtf8();
   writeColorLine("93", echo ? payload : QByteArray(command.length(), '*'));
   if (tel->isConnected()) {
-    tel->write(payload + "\r\n");
+    outgoing->enqueue(payload, lane);
   }
 }
 
@@ -233,6 +234,7 @@ void GaloshTerm::onDisconnected()
 {
   writeColorLine("", "");
   writeColorLine("1;4;31", "* Disconnected");
+  outgoing->clear();
 }
 
 void GaloshTerm::onSocketError(QAbstractSocket::SocketError err)
@@ -6,6 +6,7 @@
 #include <functional>
 #include "Vt102Emulation.h"
 #include "colorschemes.h"
+#include "commandscheduler.h"
 class QLabel;
 class QScrollBar;
 class QStackedWidget;
@@ -31,6 +32,7 @@ public:
   bool eventFilter(QObject* obj, QEvent* event);
 
   inline TelnetSocket* socket() { return tel; }
+  inline CommandScheduler* scheduler() { return outgoing; }
 
   void writeColorLine(const QByteArray& colorCode, const QByteArray& message);
 
@@ -48,7 +50,7 @@ public slots:
   void showSlashCommand(const QString& command, const QStringList& args);
   void showError(const QString& message);
   void processCommand(const QString& command, bool echo = true);
-  void transmitCommand(const QString& command, bool echo = true);
+  void transmitCommand(const QString& command, bool echo = true, CommandScheduler::Lane lane = CommandScheduler::Interactive);
   void setParsing(bool on);
 
 private slots:
@@ -67,6 +69,7 @@ private:
   Konsole::TerminalDisplay* term;
   Konsole::ScreenWindow* screen;
   TelnetSocket* tel;
+  CommandScheduler* outgoing;
   QSplitter* splitter;
   QStackedWidget* lineStack;
   CommandLine* line;
@@ -1,8 +1,11 @@
 #include "itemdatabase.h"
+#include "itemindex.h"
+#include "itemstore.h"
 #include "algorithms.h"
 #include <QSettings>
 #include <QStandardPaths>
 #include <QDir>
+#include <QFileInfo>
 #include <QRegularExpression>
 #include <QtDebug>
 #include <algorithm>
@@ -70,28 +73,33 @@ ItemParsers ItemParsers::defaultCircleMudParser = {
 };
 
 ItemDatabase::ItemDatabase(QObject* parent)
-: QAbstractListModel(parent), dbFile(nullptr)
+: QAbstractListModel(parent), dbFile(nullptr), store(new ItemStore(this)), itemIndex(new ItemIndex)
 {
   // initializers only
 }
 
+ItemDatabase::~ItemDatabase()
+{
+  // ItemIndex is incomplete in the header
+}
+
 int ItemDatabase::rowCount(const QModelIndex& parent) const
 {
   if (parent.isValid()) {
     return 0;
   }
-  return keys.count();
+  return keys.size();
 }
 
 QVariant ItemDatabase::data(const QModelIndex& index, int role) const
 {
-  if (index.parent().isValid() || index.column() != 0 || index.row() >= keys.count()) {
+  if (index.parent().isValid() || index.column() != 0 || index.row() >= keys.size()) {
     return QVariant();
   }
   if (role == Qt::DisplayRole) {
-    return keys[index.row()];
+    return keys.at(index.row());
   } else if (role == Qt::UserRole) {
-    return dbFile->value(keys[index.row()]);
+    return itemStats(keys.at(index.row()));
   } else {
     return QVariant();
   }
@@ -171,12 +179,59 @@ void ItemDatabase::load(const QString& path)
   dbFile->endGroup();
 
   dbFile->beginGroup("Items");
-  keys = dbFile->childKeys();
-  std::sort(keys.begin(), keys.end());
+  QFileInfo info(path);
+  QString storePath = info.dir().filePath(info.completeBaseName() + ".items");
+  QStringList names;
+  loadError.clear();
+  if (!QFile::exists(storePath) && !importItems(storePath)) {
+    // Nothing has been written to the store yet, so the INI file is still current
+    qWarning() << "Falling back to item data in" << path;
+    names = dbFile->childKeys();
+  } else if (!store->open(storePath)) {
+    // The INI file is older than the store, so don't quietly show stale items
+    loadError = QStringLiteral("Unable to open the item database %1. Captured items will not be saved.").arg(storePath);
+    qWarning() << loadError;
+  } else {
+    names = store->names();
+  }
+  keys.assign(names);
 
+  // Parse every item once; searches run against the index afterward
+  itemIndex->clear();
+  for (const QString& name : names) {
+    itemIndex->setItem(keys.id(name), parseItem(name, itemStats(name)));
+  }
   populateFlagTypes();
 }
 
+bool ItemDatabase::importItems(const QString& storePath)
+{
+  // Item data used to live in the INI file. The import is written to a
+  // temporary file and only renamed into place once it's complete, so an
+  // interrupted import is started over on the next load.
+  QString importPath = storePath + ".import";
+  QFile::remove(importPath);
+  if (!store->open(importPath)) {
+    return false;
+  }
+  QStringList names = dbFile->childKeys();
+  for (const QString& name : names) {
+    store->setStats(name, dbFile->value(name).toString());
+    QString keyword = dbFile->value(name + "/keyword").toString();
+    if (!keyword.isEmpty()) {
+      store->setKeyword(name, keyword);
+    }
+  }
+  bool complete = store->names().length() == names.length();
+  store->close();
+  if (!complete || !QFile::rename(importPath, storePath)) {
+    qWarning() << "Unable to import item data into" << storePath;
+    QFile::remove(importPath);
+    return false;
+  }
+  return true;
+}
+
 void ItemDatabase::processLine(const QString& line)
 {
   QObject* source = sender();
@@ -252,14 +307,11 @@ void ItemDatabase::processLine(const QString& line)
         row = keys.indexOf(itemName);
         isNew = row < 0;
         if (isNew) {
-          QStringList newKeys = keys;
-          newKeys << itemName;
-          std::sort(newKeys.begin(), newKeys.end());
-          row = keys.indexOf(itemName);
+          row = keys.lowerBound(itemName);
           beginInsertRows(QModelIndex(), row, row);
-          keys = newKeys;
+          keys.insert(itemName);
         } else {
-          QString existing = dbFile->value(itemName).toString();
+          QString existing = itemStats(itemName);
           if (pendingStats == existing) {
             // no change
             pendingCaptures.remove(source);
@@ -302,36 +354,31 @@ QList<int> ItemDatabase::searchForName(const QStringList& args) const
   if (args.isEmpty()) {
     return {};
   }
-  QList<int> filtered;
-  filtered.reserve(keys.count());
-  for (int i = 0; i < keys.count(); i++) {
-    filtered << (i + 1);
-  }
-  QRegularExpression re(args.first(), QRegularExpression::CaseInsensitiveOption);
-  QString matchZone;
+  QStringList patterns;
   for (QString arg : args) {
-    re.setPattern(arg.replace("-", ".*").replace("\\.*", "\\-"));
-    QList<int> nextRound;
-    for (int item : filtered) {
-      if (re.match(keys[item - 1]).hasMatch()) {
-        nextRound << item;
-      }
-    }
-    filtered = nextRound;
+    patterns << arg.replace("-", ".*").replace("\\.*", "\\-");
   }
-  return filtered;
+  QList<int> rows = keys.search(patterns);
+  for (int& row : rows) {
+    // Item numbers start at 1
+    ++row;
+  }
+  return rows;
 }
 
 QString ItemDatabase::itemName(int index) const
 {
-  if (index <= 0 || index > keys.count()) {
+  if (index <= 0 || index > keys.size()) {
     return QString();
   }
-  return keys[index - 1];
+  return keys.at(index - 1);
 }
 
 QString ItemDatabase::itemStats(const QString& name) const
 {
+  if (store->isOpen()) {
+    return store->stats(name);
+  }
   if (!dbFile) {
     return QString();
   }
@@ -340,6 +387,9 @@ QString ItemDatabase::itemStats(const QString& name) const
 
 QString ItemDatabase::itemKeyword(const QString& name) const
 {
+  if (store->isOpen()) {
+    return store->keyword(name);
+  }
   if (!dbFile) {
     return QString();
   }
@@ -348,15 +398,17 @@ QString ItemDatabase::itemKeyword(const QString& name) const
 
 void ItemDatabase::setItemKeyword(const QString& name, const QString& keyword)
 {
-  if (!dbFile) {
+  if (store->isOpen()) {
+    store->setKeyword(name, keyword);
+  } else if (!dbFile) {
     qWarning() << "ItemDatabase::setItemKeyword called with no database file";
     return;
-  }
-  if (keyword.isEmpty()) {
+  } else if (keyword.isEmpty()) {
     dbFile->remove(name + "/keyword");
   } else {
     dbFile->setValue(name + "/keyword", keyword);
   }
+  itemIndex->setKeyword(keys.id(name), keyword);
 }
 
 void ItemDatabase::captureEquipment(QObject* context, std::function<void(const QList<EquipSlot>&)> callback)
@@ -479,7 +531,15 @@ void ItemDatabase::updateSlotMetadata(const QList<EquipSlot>& equipment)
 
 ItemStats ItemDatabase::parsedItemStats(const QString& name) const
 {
-  QString stats = itemStats(name);
+  int id = keys.id(name);
+  if (itemIndex->contains(id)) {
+    return itemIndex->item(id);
+  }
+  return parseItem(name, itemStats(name));
+}
+
+ItemStats ItemDatabase::parseItem(const QString& name, const QString& stats) const
+{
   if (stats.isEmpty()) {
     return ItemStats();
   }
@@ -548,129 +608,38 @@ ItemStats ItemStats::parse(const QString& stats, const ItemParsers& parsers)
 
 QList<ItemStats> ItemDatabase::searchForItem(const QList<ItemQuery>& queries) const
 {
-  QList<ItemStats> results;
-
-  for (const QString& name : keys) {
-    ItemStats stats = parsedItemStats(name);
-    if (stats.name.isEmpty()) {
-      // bogus data
-      continue;
-    }
-    bool match = true;
-    for (const ItemQuery& query : queries) {
-      QStringList listValue;
-      QString strValue;
-      double numValue = 0;
-      bool isStr = false, isList = false;
-      bool isSet = false;
-      bool isExact = true;
-      if (query.stat == "name") {
-        isStr = true;
-        isExact = false;
-        strValue = stats.name.toLower();
-      } else if (query.stat == "type") {
-        isStr = true;
-        strValue = stats.type.toLower();
-      } else if (query.stat == "worn") {
-        isList = true;
-        listValue = stats.worn;
-      } else if (query.stat == "flags") {
-        isList = true;
-        listValue = stats.flags;
-      } else if (query.stat == "weight") {
-        numValue = stats.weight;
-        isSet = numValue != 0;
-      } else if (query.stat == "value") {
-        numValue = stats.value;
-        isSet = numValue != 0;
-      } else if (query.stat == "level") {
-        numValue = stats.level;
-        isSet = numValue != 0;
-      } else if (query.stat == "armor") {
-        numValue = stats.armor;
-        isSet = numValue != 0;
-      } else if (query.stat == "damage") {
-        numValue = stats.averageDamage;
-        isSet = numValue != 0;
-      } else {
-        isSet = stats.apply.contains(query.stat);
-        numValue = stats.apply.value(query.stat);
-      }
-      bool matchAll = query.compare == ItemQuery::Equal || query.compare == ItemQuery::All || query.compare == ItemQuery::Set;
-      // bool matchAny = query.compare == ItemQuery::Any; // implicit
-      bool matchNone = query.compare == ItemQuery::NotEqual || query.compare == ItemQuery::None || query.compare == ItemQuery::NotSet;
-      if (isList) {
-        bool ok = matchNone;
-        for (const QString& v : query.value.toStringList()) {
-          if (listValue.contains(v.toUpper())) {
-            if (matchNone) {
-              ok = false;
-              break;
-            }
-            ok = true;
-          } else if (matchAll) {
-            ok = false;
-            break;
-          }
-        }
-        match = ok;
-      } else if (isStr) {
-        bool ok = matchNone;
-        for (const QString& v : query.value.toStringList()) {
-          if (isExact ? strValue == v.toLower() : strValue.contains(v.toLower())) {
-            if (matchNone) {
-              ok = false;
-              break;
-            }
-            ok = true;
-          } else if (matchAll) {
-            ok = false;
-            break;
-          }
-        }
-        match = ok;
-      } else if (query.compare == ItemQuery::Equal) {
-        match = numValue == query.value.toDouble();
-      } else if (query.compare == ItemQuery::NotEqual) {
-        match = numValue != query.value.toDouble();
-      } else if (query.compare == ItemQuery::Greater) {
-        match = numValue > query.value.toDouble();
-      } else if (query.compare == ItemQuery::Less) {
-        match = numValue < query.value.toDouble();
-      } else if (query.compare == ItemQuery::GreaterEqual) {
-        match = numValue >= query.value.toDouble();
-      } else if (query.compare == ItemQuery::LessEqual) {
-        match = numValue <= query.value.toDouble();
-      } else if (query.compare == ItemQuery::Set) {
-        match = isSet;
-      } else if (query.compare == ItemQuery::NotSet) {
-        match = !isSet;
-      }
-      if (!match) {
-        break;
-      }
-    }
-    if (match) {
-      stats.keyword = itemKeyword(stats.name);
-      results << stats;
-    }
+  // Order the results the same way as the item list
+  QVector<QPair<int, int>> rows;
+  for (int id : itemIndex->search(queries)) {
+    rows << qMakePair(keys.indexOf(keys.key(id)), id);
   }
+  std::sort(rows.begin(), rows.end());
 
+  QList<ItemStats> results;
+  for (const auto& [row, id] : rows) {
+    ItemStats stats = itemIndex->item(id);
+    stats.keyword = itemKeyword(stats.name);
+    results << stats;
+  }
   return results;
 }
 
 void ItemDatabase::populateFlagTypes()
 {
-  for (const QString& name : keys) {
-    ItemStats stats = parsedItemStats(name);
-    populateFlagTypes(stats);
+  for (int id = 0; id < itemIndex->size(); id++) {
+    populateFlagTypes(itemIndex->item(id));
   }
 }
 
 void ItemDatabase::saveItem(const QString& name, const QString& statText)
 {
-  dbFile->setValue(name, statText);
-  ItemStats stats = ItemStats::parse(name, parsers);
+  if (store->isOpen()) {
+    store->setStats(name, statText);
+  } else {
+    dbFile->setValue(name, statText);
+  }
+  ItemStats stats = parseItem(name, statText);
+  itemIndex->setItem(keys.id(name), stats);
   populateFlagTypes(stats);
 }
 
@@ -6,7 +6,11 @@
 #include <QSet>
 #include <QMap>
 #include <functional>
+#include <memory>
+#include "itemkeys.h"
 class QSettings;
+class ItemIndex;
+class ItemStore;
 
 struct ItemParsers {
   static ItemParsers defaultCircleMudParser;
@@ -88,6 +92,7 @@ public:
   using EquipmentSet = QList<EquipSlot>;
 
   ItemDatabase(QObject* parent = nullptr);
+  ~ItemDatabase();
 
   ItemParsers parsers = ItemParsers::defaultCircleMudParser;
 
@@ -113,6 +118,9 @@ public:
   void setSlotKeyword(const QString& location, const QString& keyword);
   inline QStringList equipmentSlotOrder() const { return slotOrder; }
 
+  // Set when the item store exists but couldn't be opened
+  inline QString lastLoadError() const { return loadError; }
+
 public slots:
   void load(const QString& path);
   void processLine(const QString& line);
@@ -121,11 +129,16 @@ private slots:
   void abort(QObject* source = nullptr);
 
 private:
+  bool importItems(const QString& storePath);
   void updateSlotMetadata(const QList<EquipSlot>& equipment);
   void saveItem(const QString& name, const QString& stats);
+  ItemStats parseItem(const QString& name, const QString& stats) const;
   void populateFlagTypes(const ItemStats& stats);
 
   QSettings* dbFile;
+  ItemStore* store;
+  QString loadError;
+  std::unique_ptr<ItemIndex> itemIndex;
 
   struct Capture {
     QString pendingItem;
@@ -135,7 +148,7 @@ private:
     std::function<void(const QList<EquipSlot>&)> equipCallback;
   };
   QMap<QObject*, Capture> pendingCaptures;
-  QStringList keys;
+  ItemKeys keys;
   QMap<QString, EquipSlotType> slotTypes;
   QMap<QString, QString> slotKeywords;
   QStringList slotOrder;
@@ -0,0 +1,228 @@
+#include "itemindex.h"
+#include "algorithms.h"
+
+template <typename T, typename Pred>
+static void filterColumn(QBitArray& result, const QVector<T>& column, Pred pred)
+{
+  for (int i = 0; i < column.size(); i++) {
+    if (result.testBit(i) && !pred(column[i])) {
+      result.clearBit(i);
+    }
+  }
+}
+
+// Picks the comparison once so the loop over the column doesn't branch on it
+template <typename T>
+static void filterColumn(QBitArray& result, const QVector<T>& column, ItemQuery::Comparison compare, double target)
+{
+  switch (compare) {
+  case ItemQuery::Equal:
+    return filterColumn(result, column, [target](double v) { return v == target; });
+  case ItemQuery::NotEqual:
+    return filterColumn(result, column, [target](double v) { return v != target; });
+  case ItemQuery::Greater:
+    return filterColumn(result, column, [target](double v) { return v > target; });
+  case ItemQuery::Less:
+    return filterColumn(result, column, [target](double v) { return v < target; });
+  case ItemQuery::GreaterEqual:
+    return filterColumn(result, column, [target](double v) { return v >= target; });
+  case ItemQuery::LessEqual:
+    return filterColumn(result, column, [target](double v) { return v <= target; });
+  case ItemQuery::Set:
+    return filterColumn(result, column, [](double v) { return v != 0; });
+  case ItemQuery::NotSet:
+    return filterColumn(result, column, [](double v) { return v == 0; });
+  default:
+    return;
+  }
+}
+
+static bool compareValue(ItemQuery::Comparison compare, double v, double target, bool isSet)
+{
+  switch (compare) {
+  case ItemQuery::Equal:
+    return v == target;
+  case ItemQuery::NotEqual:
+    return v != target;
+  case ItemQuery::Greater:
+    return v > target;
+  case ItemQuery::Less:
+    return v < target;
+  case ItemQuery::GreaterEqual:
+    return v >= target;
+  case ItemQuery::LessEqual:
+    return v <= target;
+  case ItemQuery::Set:
+    return isSet;
+  case ItemQuery::NotSet:
+    return !isSet;
+  default:
+    return true;
+  }
+}
+
+static QBitArray sized(QBitArray bits, int count)
+{
+  bits.resize(count);
+  return bits;
+}
+
+void ItemIndex::clear()
+{
+  items.clear();
+  valid.clear();
+  level.clear();
+  value.clear();
+  armor.clear();
+  weight.clear();
+  damage.clear();
+  types.clear();
+  worn.clear();
+  flags.clear();
+  apply.clear();
+}
+
+void ItemIndex::setTerm(Terms& terms, const QString& term, int id, bool on)
+{
+  QBitArray& bits = terms[term];
+  if (bits.size() <= id) {
+    if (!on) {
+      return;
+    }
+    bits.resize(qMax(id + 1, bits.size() * 2));
+  }
+  bits.setBit(id, on);
+}
+
+void ItemIndex::setItem(int id, const ItemStats& stats)
+{
+  if (id >= items.size()) {
+    int count = id + 1;
+    items.resize(count);
+    level.resize(count);
+    value.resize(count);
+    armor.resize(count);
+    weight.resize(count);
+    damage.resize(count);
+    valid.resize(count);
+  } else {
+    const ItemStats& old = items[id];
+    setTerm(types, old.type.toLower(), id, false);
+    for (const QString& slot : old.worn) {
+      setTerm(worn, slot, id, false);
+    }
+    for (const QString& flag : old.flags) {
+      setTerm(flags, flag, id, false);
+    }
+    for (const QString& stat : old.apply.keys()) {
+      apply[stat].remove(id);
+    }
+  }
+
+  items[id] = stats;
+  valid.setBit(id, !stats.name.isEmpty());
+  level[id] = stats.level;
+  value[id] = stats.value;
+  armor[id] = stats.armor;
+  weight[id] = stats.weight;
+  damage[id] = stats.averageDamage;
+  setTerm(types, stats.type.toLower(), id, true);
+  for (const QString& slot : stats.worn) {
+    setTerm(worn, slot, id, true);
+  }
+  for (const QString& flag : stats.flags) {
+    setTerm(flags, flag, id, true);
+  }
+  for (auto iter = stats.apply.begin(); iter != stats.apply.end(); ++iter) {
+    apply[iter.key()][id] = iter.value();
+  }
+}
+
+void ItemIndex::setKeyword(int id, const QString& keyword)
+{
+  if (contains(id)) {
+    items[id].keyword = keyword;
+  }
+}
+
+QBitArray ItemIndex::term(const Terms& terms, const QString& value) const
+{
+  return sized(terms.value(value), items.size());
+}
+
+QBitArray ItemIndex::nameMatch(const QString& value, const QBitArray& candidates) const
+{
+  QBitArray result(items.size());
+  for (int i = 0; i < items.size(); i++) {
+    if (candidates.testBit(i) && items[i].name.contains(value, Qt::CaseInsensitive)) {
+      result.setBit(i);
+    }
+  }
+  return result;
+}
+
+QBitArray ItemIndex::applyMatch(const QString& stat, ItemQuery::Comparison compare, double target) const
+{
+  // Items without the stat all compare as 0, so only the items that have it need to be checked
+  QBitArray result(items.size(), compareValue(compare, 0, target, false));
+  const QHash<int, int> mods = apply.value(stat);
+  for (auto iter = mods.begin(); iter != mods.end(); ++iter) {
+    result.setBit(iter.key(), compareValue(compare, iter.value(), target, true));
+  }
+  return result;
+}
+
+QVector<int> ItemIndex::search(const QList<ItemQuery>& queries) const
+{
+  int count = items.size();
+  QBitArray result = valid;
+  for (const ItemQuery& query : queries) {
+    bool matchAll = query.compare == ItemQuery::Equal || query.compare == ItemQuery::All || query.compare == ItemQuery::Set;
+    bool matchNone = query.compare == ItemQuery::NotEqual || query.compare == ItemQuery::None || query.compare == ItemQuery::NotSet;
+    double target = query.value.toDouble();
+    if (query.stat == "name" || query.stat == "type" || query.stat == "worn" || query.stat == "flags") {
+      QStringList values = query.value.toStringList();
+      QBitArray hits(count, matchNone);
+      for (auto [i, v] : enumerate(values)) {
+        QBitArray match;
+        if (query.stat == "name") {
+          match = nameMatch(v, result);
+        } else if (query.stat == "type") {
+          match = term(types, v.toLower());
+        } else {
+          match = term(query.stat == "worn" ? worn : flags, v.toUpper());
+        }
+        if (matchNone) {
+          hits &= ~match;
+        } else if (i == 0) {
+          hits = match;
+        } else if (matchAll) {
+          hits &= match;
+        } else {
+          hits |= match;
+        }
+      }
+      result &= hits;
+    } else if (query.stat == "weight") {
+      filterColumn(result, weight, query.compare, target);
+    } else if (query.stat == "value") {
+      filterColumn(result, value, query.compare, target);
+    } else if (query.stat == "level") {
+      filterColumn(result, level, query.compare, target);
+    } else if (query.stat == "armor") {
+      filterColumn(result, armor, query.compare, target);
+    } else if (query.stat == "damage") {
+      filterColumn(result, damage, query.compare, target);
+    } else {
+      result &= applyMatch(query.stat, query.compare, target);
+    }
+  }
+
+  QVector<int> matches;
+  for (int i = 0; i < count; i++) {
+    if (result.testBit(i)) {
+      matches << i;
+    }
+  }
+  return matches;
+}
@@ -0,0 +1,51 @@
+#ifndef GALOSH_ITEMINDEX_H
+#define GALOSH_ITEMINDEX_H
+
+#include <QBitArray>
+#include <QHash>
+#include <QString>
+#include <QVector>
+#include "itemdatabase.h"
+
+// Parsed stats of every item in the database, stored column by column so
+// queries can be answered without parsing the item text again. Flags, worn
+// slots and types are kept as one bitset per value; apply stats are sparse.
+// Items are identified by their ItemKeys node ID.
+class ItemIndex
+{
+public:
+  void clear();
+  inline int size() const { return items.size(); }
+
+  // Adds an item or replaces the stats of an existing one
+  void setItem(int id, const ItemStats& stats);
+  void setKeyword(int id, const QString& keyword);
+  inline bool contains(int id) const { return id >= 0 && id < items.size(); }
+  inline const ItemStats& item(int id) const { return items[id]; }
+
+  // Returns the IDs of the matching items in ascending order
+  QVector<int> search(const QList<ItemQuery>& queries) const;
+
+private:
+  using Terms = QHash<QString, QBitArray>;
+  static void setTerm(Terms& terms, const QString& term, int id, bool on);
+  QBitArray term(const Terms& terms, const QString& value) const;
+  QBitArray nameMatch(const QString& value, const QBitArray& candidates) const;
+  QBitArray applyMatch(const QString& stat, ItemQuery::Comparison compare, double target) const;
+
+  QVector<ItemStats> items;
+  // Items with usable stats
+  QBitArray valid;
+
+  QVector<int> level;
+  QVector<int> value;
+  QVector<int> armor;
+  QVector<double> weight;
+  QVector<double> damage;
+  Terms types;
+  Terms worn;
+  Terms flags;
+  QHash<QString, QHash<int, int>> apply;
+};
+
+#endif
@@ -0,0 +1,203 @@
+#include "itemkeys.h"
+#include "trigrams.h"
+#include <QRandomGenerator>
+#include <QRegularExpression>
+#include <algorithm>
+#include <numeric>
+
+ItemKeys::ItemKeys()
+: root(-1)
+{
+  // initializers only
+}
+
+void ItemKeys::clear()
+{
+  nodes.clear();
+  ids.clear();
+  postings.clear();
+  root = -1;
+}
+
+int ItemKeys::addNode(const QString& key)
+{
+  int id = nodes.size();
+  nodes << (Node){ key, -1, -1, 1, QRandomGenerator::global()->generate() };
+  ids[key] = id;
+  for (quint64 trigram : trigrams(key)) {
+    postings[trigram] << id;
+  }
+  return id;
+}
+
+void ItemKeys::assign(const QStringList& keys)
+{
+  clear();
+  QStringList sorted = keys;
+  std::sort(sorted.begin(), sorted.end());
+  sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+  nodes.reserve(sorted.size());
+
+  // Build the treap in one pass over the sorted names, keeping the right spine on a stack
+  QVector<int> spine;
+  for (const QString& key : sorted) {
+    int id = addNode(key);
+    int last = -1;
+    while (!spine.isEmpty() && nodes[spine.last()].priority < nodes[id].priority) {
+      last = spine.takeLast();
+    }
+    nodes[id].left = last;
+    if (!spine.isEmpty()) {
+      nodes[spine.last()].right = id;
+    }
+    spine << id;
+  }
+  root = spine.isEmpty() ? -1 : spine.first();
+  updateSize(root);
+}
+
+int ItemKeys::updateSize(int node)
+{
+  if (node < 0) {
+    return 0;
+  }
+  Node& n = nodes[node];
+  n.size = 1 + updateSize(n.left) + updateSize(n.right);
+  return n.size;
+}
+
+void ItemKeys::split(int node, const QString& key, int* left, int* right)
+{
+  if (node < 0) {
+    *left = *right = -1;
+    return;
+  }
+  Node& n = nodes[node];
+  if (n.key < key) {
+    split(n.right, key, &n.right, right);
+    *left = node;
+  } else {
+    split(n.left, key, left, &n.left);
+    *right = node;
+  }
+  n.size = 1 + sizeOf(n.left) + sizeOf(n.right);
+}
+
+int ItemKeys::insertNode(int node, int id, int offset, int* row)
+{
+  if (node < 0 || nodes[id].priority > nodes[node].priority) {
+    split(node, nodes[id].key, &nodes[id].left, &nodes[id].right);
+    nodes[id].size = 1 + sizeOf(nodes[id].left) + sizeOf(nodes[id].right);
+    *row = offset + sizeOf(nodes[id].left);
+    return id;
+  }
+  if (nodes[id].key < nodes[node].key) {
+    int child = insertNode(nodes[node].left, id, offset, row);
+    nodes[node].left = child;
+  } else {
+    int child = insertNode(nodes[node].right, id, offset + sizeOf(nodes[node].left) + 1, row);
+    nodes[node].right = child;
+  }
+  nodes[node].size++;
+  return node;
+}
+
+int ItemKeys::insert(const QString& key)
+{
+  if (ids.contains(key)) {
+    return -1;
+  }
+  int id = addNode(key);
+  int row = 0;
+  root = insertNode(root, id, 0, &row);
+  return row;
+}
+
+int ItemKeys::lowerBound(const QString& key) const
+{
+  int row = 0;
+  int node = root;
+  while (node >= 0) {
+    const Node& n = nodes[node];
+    if (n.key < key) {
+      row += sizeOf(n.left) + 1;
+      node = n.right;
+    } else {
+      node = n.left;
+    }
+  }
+  return row;
+}
+
+int ItemKeys::indexOf(const QString& key) const
+{
+  return ids.contains(key) ? lowerBound(key) : -1;
+}
+
+const QString& ItemKeys::at(int row) const
+{
+  int node = root;
+  while (node >= 0) {
+    const Node& n = nodes[node];
+    int leftSize = sizeOf(n.left);
+    if (row < leftSize) {
+      node = n.left;
+    } else if (row == leftSize) {
+      return n.key;
+    } else {
+      row -= leftSize + 1;
+      node = n.right;
+    }
+  }
+  static const QString none;
+  return none;
+}
+
+QList<int> ItemKeys::search(const QStringList& patterns) const
+{
+  QSet<quint64> keys;
+  for (const QString& pattern : patterns) {
+    for (const QString& literal : requiredLiterals(pattern)) {
+      keys += trigrams(literal);
+    }
+  }
+
+  QVector<int> candidates;
+  if (keys.isEmpty()) {
+    // Nothing to narrow the search with, so check every name
+    candidates.resize(nodes.size());
+    std::iota(candidates.begin(), candidates.end(), 0);
+  } else {
+    QList<const QVector<int>*> lists;
+    for (quint64 key : keys) {
+      auto iter = postings.constFind(key);
+      if (iter == postings.constEnd()) {
+        return {};
+      }
+      lists << &*iter;
+    }
+    std::sort(lists.begin(), lists.end(), [](const QVector<int>* lhs, const QVector<int>* rhs) { return lhs->size() < rhs->size(); });
+    candidates = *lists.first();
+    QVector<int> next;
+    for (const QVector<int>* list : lists.mid(1)) {
+      next.clear();
+      std::set_intersection(candidates.begin(), candidates.end(), list->begin(), list->end(), std::back_inserter(next));
+      std::swap(candidates, next);
+    }
+  }
+
+  QList<QRegularExpression> res;
+  for (const QString& pattern : patterns) {
+    res << QRegularExpression(pattern, QRegularExpression::CaseInsensitiveOption);
+  }
+  QList<int> rows;
+  for (int id : candidates) {
+    const QString& key = nodes[id].key;
+    bool match = std::all_of(res.begin(), res.end(), [&key](const QRegularExpression& re) { return re.match(key).hasMatch(); });
+    if (match) {
+      rows << lowerBound(key);
+    }
+  }
+  std::sort(rows.begin(), rows.end());
+  return rows;
+}
@@ -0,0 +1,59 @@
+#ifndef GALOSH_ITEMKEYS_H
+#define GALOSH_ITEMKEYS_H
+
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// Sorted set of item names. The names are kept in a treap that tracks subtree
+// sizes, so inserting a name and converting between names and rows both take
+// O(log n). A trigram index over the names narrows down name searches.
+class ItemKeys
+{
+public:
+  ItemKeys();
+
+  inline int size() const { return nodes.size(); }
+  inline bool contains(const QString& key) const { return ids.contains(key); }
+  void clear();
+  void assign(const QStringList& keys);
+
+  // Returns the row of the new name, or -1 if it was already present
+  int insert(const QString& key);
+  // Returns the row of the name, or -1 if it isn't present
+  int indexOf(const QString& key) const;
+  // Returns the row the name would be inserted at
+  int lowerBound(const QString& key) const;
+  const QString& at(int row) const;
+  // Node IDs don't change when other names are inserted, so they can key parallel data
+  inline int id(const QString& key) const { return ids.value(key, -1); }
+  inline const QString& key(int id) const { return nodes[id].key; }
+
+  // Rows of the names that match every pattern (case-insensitive), in order
+  QList<int> search(const QStringList& patterns) const;
+
+private:
+  struct Node {
+    QString key;
+    int left;
+    int right;
+    int size;
+    quint32 priority;
+  };
+
+  inline int sizeOf(int node) const { return node < 0 ? 0 : nodes[node].size; }
+  int updateSize(int node);
+  void split(int node, const QString& key, int* left, int* right);
+  int insertNode(int node, int id, int offset, int* row);
+  int addNode(const QString& key);
+
+  QVector<Node> nodes;
+  int root;
+  QHash<QString, int> ids;
+  // Trigram -> node IDs, in ascending order
+  QHash<quint64, QVector<int>> postings;
+};
+
+#endif
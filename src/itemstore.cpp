@@ -0,0 +1,294 @@
+#include "itemstore.h"
+#include <QtConcurrent>
+#include <QtEndian>
+#include <QtDebug>
+#include <algorithm>
+
+static constexpr quint32 STORE_MAGIC = 0x4749544d;
+static constexpr quint32 STORE_VERSION = 1;
+static constexpr qint64 HEADER_SIZE = 8;
+// Type, name length, value length
+static constexpr qint64 RECORD_HEADER_SIZE = 9;
+// Don't bother compacting small files
+static constexpr qint64 COMPACT_MIN_SIZE = 1 << 20;
+
+ItemStore::ItemStore(QObject* parent)
+: QObject(parent), mapped(nullptr), mappedSize(0), fileSize(0), liveBytes(0), compactWatcher(new QFutureWatcher<bool>(this)), compactFrom(0)
+{
+  QObject::connect(compactWatcher, SIGNAL(finished()), this, SLOT(compactFinished()));
+}
+
+ItemStore::~ItemStore()
+{
+  close();
+}
+
+bool ItemStore::open(const QString& filename)
+{
+  close();
+  path = filename;
+  // Left behind if the program exited during a compaction
+  QFile::remove(path + ".compact");
+  file.setFileName(path);
+  if (!file.open(QIODevice::ReadWrite)) {
+    qWarning() << "Unable to open item store" << path << file.errorString();
+    return false;
+  }
+  if (file.size() == 0) {
+    QByteArray header(HEADER_SIZE, 0);
+    qToLittleEndian<quint32>(STORE_MAGIC, header.data());
+    qToLittleEndian<quint32>(STORE_VERSION, header.data() + 4);
+    file.write(header);
+    file.flush();
+  }
+  if (!scan()) {
+    qWarning() << "Item store" << path << "is not readable";
+    close();
+    return false;
+  }
+  return true;
+}
+
+void ItemStore::close()
+{
+  if (compactWatcher->isRunning()) {
+    // Drop the result; the file it was compacting is going away
+    compactWatcher->waitForFinished();
+    compactWatcher->setFuture(QFuture<bool>());
+    QFile::remove(path + ".compact");
+  }
+  if (mapped) {
+    file.unmap(mapped);
+    mapped = nullptr;
+    mappedSize = 0;
+  }
+  file.close();
+  entries.clear();
+  fileSize = 0;
+  liveBytes = 0;
+}
+
+bool ItemStore::remap() const
+{
+  if (mapped) {
+    file.unmap(mapped);
+    mapped = nullptr;
+    mappedSize = 0;
+  }
+  if (fileSize == 0) {
+    return true;
+  }
+  mapped = file.map(0, fileSize);
+  if (!mapped) {
+    return false;
+  }
+  mappedSize = fileSize;
+  return true;
+}
+
+bool ItemStore::scan()
+{
+  entries.clear();
+  liveBytes = 0;
+  fileSize = file.size();
+  if (fileSize < HEADER_SIZE || !remap()) {
+    return false;
+  }
+  if (qFromLittleEndian<quint32>(mapped) != STORE_MAGIC || qFromLittleEndian<quint32>(mapped + 4) != STORE_VERSION) {
+    return false;
+  }
+
+  qint64 pos = HEADER_SIZE;
+  while (pos + RECORD_HEADER_SIZE <= fileSize) {
+    const uchar* record = mapped + pos;
+    quint8 type = record[0];
+    quint32 nameLength = qFromLittleEndian<quint32>(record + 1);
+    quint32 valueLength = qFromLittleEndian<quint32>(record + 5);
+    qint64 size = RECORD_HEADER_SIZE + nameLength + valueLength;
+    if (type != StatsRecord && type != KeywordRecord) {
+      // Don't truncate anything that isn't a torn write; the data may still be recoverable
+      qWarning() << "Unknown record type" << type << "at offset" << pos << "in" << path;
+      return false;
+    }
+    if (pos + size > fileSize) {
+      break;
+    }
+    QString name = QString::fromUtf8(reinterpret_cast<const char*>(record + RECORD_HEADER_SIZE), nameLength);
+    Entry& entry = entries[name];
+    Span& span = type == StatsRecord ? entry.stats : entry.keyword;
+    liveBytes += size - span.recordSize;
+    span = Span{ pos + RECORD_HEADER_SIZE + nameLength, valueLength, quint32(size) };
+    pos += size;
+  }
+
+  if (pos < fileSize) {
+    // Drop a record that was only partly written
+    qWarning() << "Discarding" << (fileSize - pos) << "bytes at the end of" << path;
+    file.unmap(mapped);
+    mapped = nullptr;
+    file.resize(pos);
+    fileSize = pos;
+    remap();
+  }
+  return true;
+}
+
+QStringList ItemStore::names() const
+{
+  QStringList result;
+  result.reserve(entries.size());
+  for (auto iter = entries.begin(); iter != entries.end(); ++iter) {
+    if (iter->stats.offset >= 0) {
+      result << iter.key();
+    }
+  }
+  return result;
+}
+
+QString ItemStore::read(const Span& span) const
+{
+  if (span.offset < 0) {
+    return QString();
+  }
+  if (span.offset + span.length > mappedSize && !remap()) {
+    return QString();
+  }
+  return QString::fromUtf8(reinterpret_cast<const char*>(mapped + span.offset), span.length);
+}
+
+QString ItemStore::stats(const QString& name) const
+{
+  auto iter = entries.constFind(name);
+  return iter == entries.constEnd() ? QString() : read(iter->stats);
+}
+
+QString ItemStore::keyword(const QString& name) const
+{
+  auto iter = entries.constFind(name);
+  return iter == entries.constEnd() ? QString() : read(iter->keyword);
+}
+
+void ItemStore::setStats(const QString& name, const QString& stats)
+{
+  append(StatsRecord, name, stats);
+}
+
+void ItemStore::setKeyword(const QString& name, const QString& keyword)
+{
+  append(KeywordRecord, name, keyword);
+}
+
+void ItemStore::append(RecordType type, const QString& name, const QString& value)
+{
+  if (!file.isOpen()) {
+    qWarning() << "Dropping write to closed item store" << path << name;
+    return;
+  }
+  QByteArray nameData = name.toUtf8();
+  QByteArray valueData = value.toUtf8();
+  QByteArray record(RECORD_HEADER_SIZE, 0);
+  record[0] = char(type);
+  qToLittleEndian<quint32>(nameData.size(), record.data() + 1);
+  qToLittleEndian<quint32>(valueData.size(), record.data() + 5);
+  record += nameData;
+  record += valueData;
+
+  file.seek(fileSize);
+  if (file.write(record) != record.size() || !file.flush()) {
+    qWarning() << "Unable to write to item store" << path << file.errorString();
+    file.resize(fileSize);
+    return;
+  }
+
+  Entry& entry = entries[name];
+  Span& span = type == StatsRecord ? entry.stats : entry.keyword;
+  liveBytes += record.size() - span.recordSize;
+  span = Span{ fileSize + RECORD_HEADER_SIZE + nameData.size(), quint32(valueData.size()), quint32(record.size()) };
+  fileSize += record.size();
+  maybeCompact();
+}
+
+void ItemStore::maybeCompact()
+{
+  if (compactWatcher->isRunning() || fileSize < COMPACT_MIN_SIZE || liveBytes * 2 > fileSize) {
+    return;
+  }
+
+  // The log is append-only, so everything before compactFrom stays put while the worker reads it
+  QVector<QPair<qint64, quint32>> records;
+  for (const Entry& entry : entries) {
+    for (const Span* span : { &entry.stats, &entry.keyword }) {
+      if (span->offset >= 0) {
+        records << qMakePair(span->offset + span->length - span->recordSize, span->recordSize);
+      }
+    }
+  }
+  std::sort(records.begin(), records.end());
+  compactFrom = fileSize;
+  QString source = path;
+  compactWatcher->setFuture(QtConcurrent::run([source, records]{ return writeLive(source, source + ".compact", records); }));
+}
+
+bool ItemStore::writeLive(const QString& source, const QString& dest, const QVector<QPair<qint64, quint32>>& records)
+{
+  QFile in(source);
+  if (!in.open(QIODevice::ReadOnly)) {
+    return false;
+  }
+  QFile out(dest);
+  if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    return false;
+  }
+  qint64 size = records.isEmpty() ? HEADER_SIZE : records.last().first + records.last().second;
+  const uchar* data = in.map(0, size);
+  if (!data) {
+    return false;
+  }
+  bool ok = out.write(reinterpret_cast<const char*>(data), HEADER_SIZE) == HEADER_SIZE;
+  for (const auto& [offset, length] : records) {
+    ok = ok && out.write(reinterpret_cast<const char*>(data + offset), length) == length;
+  }
+  in.unmap(const_cast<uchar*>(data));
+  return ok && out.flush();
+}
+
+void ItemStore::compactFinished()
+{
+  QFuture<bool> future = compactWatcher->future();
+  if (!future.isFinished() || future.resultCount() == 0) {
+    return;
+  }
+  QString compactPath = path + ".compact";
+  if (!file.isOpen() || !future.result()) {
+    QFile::remove(compactPath);
+    return;
+  }
+
+  // Carry over the records appended while the worker was running
+  QFile compacted(compactPath);
+  bool ok = compacted.open(QIODevice::Append);
+  if (ok && fileSize > compactFrom && (mappedSize >= fileSize || remap())) {
+    qint64 length = fileSize - compactFrom;
+    ok = compacted.write(reinterpret_cast<const char*>(mapped + compactFrom), length) == length;
+  }
+  ok = ok && compacted.flush();
+  compacted.close();
+  if (!ok) {
+    QFile::remove(compactPath);
+    return;
+  }
+
+  QString filename = path;
+  QString oldPath = path + ".old";
+  close();
+  QFile::remove(oldPath);
+  if (QFile::rename(filename, oldPath)) {
+    if (QFile::rename(compactPath, filename)) {
+      QFile::remove(oldPath);
+    } else {
+      QFile::rename(oldPath, filename);
+    }
+  }
+  QFile::remove(compactPath);
+  open(filename);
+}
@@ -0,0 +1,75 @@
+#ifndef GALOSH_ITEMSTORE_H
+#define GALOSH_ITEMSTORE_H
+
+#include <QObject>
+#include <QFile>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QPair>
+#include <QFutureWatcher>
+
+// Append-only log of item stats and keywords. Every change appends a record
+// and the newest record for each name wins. An in-memory index maps names to
+// record offsets, and values are read from a memory-mapped view of the file.
+// When most of the file is superseded records, it's rewritten in the background.
+class ItemStore : public QObject
+{
+Q_OBJECT
+public:
+  ItemStore(QObject* parent = nullptr);
+  ~ItemStore();
+
+  bool open(const QString& path);
+  void close();
+  inline bool isOpen() const { return file.isOpen(); }
+
+  QStringList names() const;
+  QString stats(const QString& name) const;
+  QString keyword(const QString& name) const;
+  void setStats(const QString& name, const QString& stats);
+  void setKeyword(const QString& name, const QString& keyword);
+
+private slots:
+  void compactFinished();
+
+private:
+  enum RecordType : quint8 {
+    StatsRecord = 1,
+    KeywordRecord = 2,
+  };
+
+  struct Span {
+    // Offset and length of the value; size of the whole record
+    qint64 offset = -1;
+    quint32 length = 0;
+    quint32 recordSize = 0;
+  };
+
+  struct Entry {
+    Span stats;
+    Span keyword;
+  };
+
+  static bool writeLive(const QString& source, const QString& dest, const QVector<QPair<qint64, quint32>>& records);
+
+  bool scan();
+  bool remap() const;
+  QString read(const Span& span) const;
+  void append(RecordType type, const QString& name, const QString& value);
+  void maybeCompact();
+
+  QString path;
+  mutable QFile file;
+  mutable uchar* mapped;
+  mutable qint64 mappedSize;
+  qint64 fileSize;
+  qint64 liveBytes;
+  QHash<QString, Entry> entries;
+
+  QFutureWatcher<bool>* compactWatcher;
+  qint64 compactFrom;
+};
+
+#endif
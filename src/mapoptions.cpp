@@ -58,6 +58,12 @@ MapOptions::MapOptions(MapManager* map, QWidget* parent)
     item->setFlags(Qt::ItemIsSelectable | Qt::ItemIsEditable | Qt::ItemIsEnabled);
   }
 
+  for (int roomId : map->routeAvoidRooms())
+  {
+    QListWidgetItem* item = new QListWidgetItem(QString::number(roomId), avoidRooms);
+    item->setFlags(Qt::ItemIsSelectable | Qt::ItemIsEditable | Qt::ItemIsEnabled);
+  }
+
   QObject::connect(table, SIGNAL(cellChanged(int,int)), this, SLOT(onCellChanged(int,int)));
   QObject::connect(table, SIGNAL(itemDoubleClicked(QTableWidgetItem*)), this, SLOT(onItemDoubleClicked(QTableWidgetItem*)));
   QObject::connect(buttons, SIGNAL(accepted()), this, SLOT(accept()));
@@ -118,6 +124,25 @@ QWidget* MapOptions::makeRoutingTab(QWidget* parent)
   QObject::connect(delButton, SIGNAL(clicked()), this, SLOT(removeAvoids()));
   lButtons->addWidget(delButton);
 
+  QGroupBox* gAvoidRooms = new QGroupBox("Avoid R&ooms:", tRouting);
+  QVBoxLayout* lAvoidRooms = new QVBoxLayout(gAvoidRooms);
+  lRouting->addWidget(gAvoidRooms, 1);
+
+  avoidRooms = new QListWidget(tRouting);
+  lAvoidRooms->addWidget(avoidRooms, 1);
+
+  QHBoxLayout* lRoomButtons = new QHBoxLayout;
+  lRoomButtons->addStretch(1);
+  lAvoidRooms->addLayout(lRoomButtons, 0);
+
+  QPushButton* addRoomButton = new QPushButton("Add", this);
+  QObject::connect(addRoomButton, SIGNAL(clicked()), this, SLOT(addAvoidRoom()));
+  lRoomButtons->addWidget(addRoomButton);
+
+  QPushButton* delRoomButton = new QPushButton("Delete", this);
+  QObject::connect(delRoomButton, SIGNAL(clicked()), this, SLOT(removeAvoidRooms()));
+  lRoomButtons->addWidget(delRoomButton);
+
   // prioritize cost vs prioritize distance
   // disable automapping
 
@@ -179,6 +204,18 @@ bool MapOptions::save()
   }
   map->setRouteAvoidZones(avoidZones);
 
+  QList<int> avoidRoomIds;
+  for (int i = 0; i < avoidRooms->count(); i++) {
+    bool ok = false;
+    int roomId = avoidRooms->item(i)->data(Qt::EditRole).toString().toInt(&ok);
+    if (ok && !avoidRoomIds.contains(roomId)) {
+      avoidRoomIds << roomId;
+    }
+  }
+  if (avoidRoomIds != map->routeAvoidRooms()) {
+    map->setRouteAvoidRooms(avoidRoomIds);
+  }
+
   return true;
 }
 
@@ -287,3 +324,26 @@ void MapOptions::removeAvoids()
   }
   isDirty = true;
 }
+
+void MapOptions::addAvoidRoom()
+{
+  QListWidgetItem* item = new QListWidgetItem("", avoidRooms);
+  item->setFlags(Qt::ItemIsSelectable | Qt::ItemIsEditable | Qt::ItemIsEnabled);
+  avoidRooms->setCurrentItem(item);
+  avoidRooms->editItem(item);
+  isDirty = true;
+}
+
+void MapOptions::removeAvoidRooms()
+{
+  QSet<int> rows;
+  for (QListWidgetItem* item : avoidRooms->selectedItems()) {
+    rows << avoidRooms->row(item);
+  }
+  QList<int> sorted = rows.values();
+  std::sort(sorted.rbegin(), sorted.rend());
+  for (int row : sorted) {
+    delete avoidRooms->takeItem(row);
+  }
+  isDirty = true;
+}
@@ -26,6 +26,8 @@ private slots:
 
   void addAvoid();
   void removeAvoids();
+  void addAvoidRoom();
+  void removeAvoidRooms();
 
 private:
   QWidget* makeColorTab(QWidget* parent);
@@ -34,6 +36,7 @@ private:
   MapManager* map;
   QTableWidget* table;
   QListWidget* avoid;
+  QListWidget* avoidRooms;
   bool isDirty;
 };
 
@@ -1,10 +1,12 @@
 #include "automapper.h"
 #include "mapmanager.h"
+#include "explorehistory.h"
+#include "algorithms.h"
 #include <QtDebug>
 
-AutoMapper::AutoMapper(MapManager* map, QObject* parent)
-: QObject(parent), map(map), logRoomLegacy(false), logRoomDescription(false), logExits(false), roomDirty(false),
-  currentRoomId(-1), destinationRoomId(-1), previousRoomId(-1)
+AutoMapper::AutoMapper(MapManager* map, const ExploreHistory* history, QObject* parent)
+: QObject(parent), map(map), history(history), logRoomLegacy(false), logRoomDescription(false), logExits(false), roomDirty(false),
+  capturingNewRoom(false), unexpectedMove(false), currentRoomId(-1), destinationRoomId(-1), previousRoomId(-1)
 {
   QObject::connect(map, SIGNAL(reset()), this, SLOT(reset()));
 }
@@ -38,6 +40,7 @@ void AutoMapper::commandEntered(const QString& rawCommand, bool echo)
     qDebug() << "GOTO";
     // TODO: reidentify room heuristics?
     destinationRoomId = map->autoRoomId++;
+    unexpectedMove = true;
     logRoomLegacy = true;
     logRoomDescription = false;
     logExits = false;
@@ -63,14 +66,17 @@ void AutoMapper::commandEntered(const QString& rawCommand, bool echo)
       dir = "SOMEWHERE";
     }
     destinationDir = dir;
+    unexpectedMove = false;
     if (isLook) {
       destinationRoomId = currentRoomId;
     } else if (!room) {
       destinationRoomId = map->autoRoomId++;
+      unexpectedMove = true;
     } else if (room->exits.contains(dir)) {
       int dest = room->exits.value(dir).dest;
       if (dest < 0) {
         room->exits[dir].dest = dest = map->autoRoomId++;
+        map->invalidateRoom(currentRoomId);
       }
       destinationRoomId = dest;
     } else {
@@ -114,7 +120,6 @@ void AutoMapper::processLine(const QString& line)
         logRoomLegacy = false;
         return;
       } else {
-        // TODO: figure out if we're not where we think we are (description hashing?)
         if (currentRoomId >= 0 && destinationRoomId >= 0 && currentRoomId != destinationRoomId) {
           MapRoom* room = map->mutableRoom(destinationRoomId);
           QString back = MapRoom::reverseDir(destinationDir);
@@ -123,6 +128,7 @@ void AutoMapper::processLine(const QString& line)
               room->exits[back].dest = currentRoomId;
             } else if (room->exits[back].dest != currentRoomId) {
               qDebug() << "not where we thought we were!";
+              unexpectedMove = true;
             }
           }
         }
@@ -134,6 +140,10 @@ void AutoMapper::processLine(const QString& line)
         }
         MapRoom* room = map->mutableRoom(currentRoomId);
         QString roomName = pendingLines.takeFirst();
+        pendingName = roomName;
+        capturingNewRoom = room->name.isEmpty();
+        // A known room showing up under another name means we're somewhere else
+        unexpectedMove = unexpectedMove || (!capturingNewRoom && room->name != roomName);
         if (room->name.isEmpty() || destinationDir == "LOOK") {
           roomDirty = true;
           room->name = roomName;
@@ -173,15 +183,19 @@ void AutoMapper::processLine(const QString& line)
       pendingDescription = pendingDescription.trimmed().mid(1);
       bool exitsDirty = false;
       if (line.startsWith("Exits:")) {
-        QStringList exits = line.mid(6).trimmed().split(' ');
+        QStringList exits = line.mid(6).trimmed().split(' ', Qt::SkipEmptyParts);
+        QStringList exitDirs;
+        for (const QString& exit : exits) {
+          exitDirs << MapRoom::normalizeDir(exit.startsWith('[') ? exit.mid(1, exit.length() - 2) : exit);
+        }
+        if (relocate(exitDirs)) {
+          return;
+        }
         MapRoom& room = map->rooms[currentRoomId];
         QString back = MapRoom::reverseDir(destinationDir);
-        for (QString exit : exits) {
-          bool locked = exit.startsWith('[');
-          if (locked) {
-            exit = exit.mid(1, exit.length() - 2);
-          }
-          exit = MapRoom::normalizeDir(exit);
+        for (int i = 0; i < exits.length(); i++) {
+          bool locked = exits[i].startsWith('[');
+          const QString& exit = exitDirs[i];
           if (!room.exits.contains(exit)) {
             if (exit == back) {
               room.exits[exit].dest = previousRoomId;
@@ -207,11 +221,9 @@ void AutoMapper::processLine(const QString& line)
           MapZone* zone = map->mutableZone("");
           if (!zone->roomIds.contains(currentRoomId)) {
             zone->roomIds << currentRoomId;
-            if (map->mapSearch) {
-              map->mapSearch->markDirty(zone);
-            }
           }
         }
+        map->invalidateRoom(currentRoomId);
         map->saveRoom(&map->rooms[currentRoomId]);
       }
       // TODO: emit currentRoomIdUpdated(this, currentRoomId);
@@ -243,10 +255,11 @@ void AutoMapper::processLine(const QString& line)
     if (destId < 0) {
       room->exits[dir].dest = destId = map->autoRoomId++;
     }
-    MapRoom* destRoom = &map->rooms[destId];
+    MapRoom* destRoom = map->mutableRoom(destId);
     if (destRoom->name.isEmpty()) {
       // TODO: in legacy mode, detect if we're in an unexpected place
       destRoom->name = dest;
+      map->reindexRoom(destRoom);
       roomDirty = true;
     }
   } else if (map->rooms.contains(currentRoomId) && map->rooms[currentRoomId].name == line && map->rooms[currentRoomId].description.isEmpty()) {
@@ -257,6 +270,84 @@ void AutoMapper::processLine(const QString& line)
   }
 }
 
+bool AutoMapper::relocate(const QStringList& exits)
+{
+  const MapRoom* room = map->room(currentRoomId);
+  if (!room) {
+    return false;
+  }
+  // A new room reached through a known exit is just a new room, even if it
+  // looks like one we've seen. Only second-guess the position when the move
+  // didn't follow a known exit or the room doesn't match what we expected.
+  bool mismatch = !room->description.isEmpty() && !pendingDescription.isEmpty() && room->description != pendingDescription;
+  if (!unexpectedMove && !mismatch) {
+    return false;
+  }
+
+  QList<int> candidates = map->matchingRooms(pendingName, pendingDescription, exits);
+  candidates.removeAll(currentRoomId);
+  int actualId = resolveCandidates(candidates);
+  if (actualId < 0) {
+    return false;
+  }
+
+  // Point the exit we took at the room we recognized instead of the placeholder or the wrong room
+  MapRoom* prev = map->mutableRoom(previousRoomId);
+  if (prev && prev->exits.contains(destinationDir) && prev->exits[destinationDir].dest == currentRoomId) {
+    prev->exits[destinationDir].dest = actualId;
+    map->invalidateRoom(previousRoomId);
+    map->saveRoom(prev);
+  }
+  if (capturingNewRoom) {
+    map->removeRoom(currentRoomId);
+  }
+  currentRoomId = actualId;
+  endRoomCapture();
+  return true;
+}
+
+int AutoMapper::resolveCandidates(const QList<int>& candidates) const
+{
+  if (candidates.isEmpty()) {
+    return -1;
+  }
+
+  // Identical-looking rooms are common, so even a single candidate needs to be
+  // one we've just been in or connected to. Prefer the most recent evidence.
+  QList<int> recent;
+  if (previousRoomId >= 0) {
+    recent << previousRoomId;
+  }
+  if (history) {
+    for (int roomId : history->recentRooms(5)) {
+      if (!recent.contains(roomId)) {
+        recent << roomId;
+      }
+    }
+  }
+
+  int bestId = -1, bestScore = 0;
+  bool tied = false;
+  for (int candidateId : candidates) {
+    const MapRoom* candidate = map->room(candidateId);
+    int score = 0;
+    for (auto [i, roomId] : enumerate(recent)) {
+      const MapRoom* other = map->room(roomId);
+      if (roomId == candidateId || candidate->hasExitTo(roomId) || (other && other->hasExitTo(candidateId))) {
+        score += recent.length() - i;
+      }
+    }
+    if (score > bestScore) {
+      bestId = candidateId;
+      bestScore = score;
+      tied = false;
+    } else if (score > 0 && score == bestScore) {
+      tied = true;
+    }
+  }
+  return tied ? -1 : bestId;
+}
+
 void AutoMapper::endRoomCapture()
 {
   if (currentRoomId >= 0) {
@@ -264,9 +355,12 @@ void AutoMapper::endRoomCapture()
   }
   destinationRoomId = -1;
   previousRoomId = -1;
+  pendingName.clear();
   pendingDescription.clear();
   pendingLines.clear();
   roomDirty = false;
+  capturingNewRoom = false;
+  unexpectedMove = false;
   destinationDir.clear();
   logRoomLegacy = false;
   logRoomDescription = false;
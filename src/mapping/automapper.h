@@ -4,12 +4,13 @@
 #include <QObject>
 class MapManager;
 class MapRoom;
+class ExploreHistory;
 
 class AutoMapper : public QObject
 {
 Q_OBJECT
 public:
-  AutoMapper(MapManager* map, QObject* parent = nullptr);
+  AutoMapper(MapManager* map, const ExploreHistory* history = nullptr, QObject* parent = nullptr);
 
   const MapRoom* currentRoom() const;
 
@@ -27,13 +28,20 @@ private slots:
 
 private:
   void endRoomCapture();
+  bool relocate(const QStringList& exits);
+  int resolveCandidates(const QList<int>& candidates) const;
 
   MapManager* map;
+  const ExploreHistory* history;
 
   bool logRoomLegacy;
   bool logRoomDescription;
   bool logExits;
   bool roomDirty;
+  bool capturingNewRoom;
+  // The last move didn't follow a known exit, or what we saw doesn't match where it should have led
+  bool unexpectedMove;
+  QString pendingName;
   QString pendingDescription;
   QStringList pendingLines;
   int currentRoomId;
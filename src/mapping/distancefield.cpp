@@ -0,0 +1,179 @@
+#include "distancefield.h"
+#include "mapmanager.h"
+#include <queue>
+#include <vector>
+
+DistanceField::DistanceField(MapManager* map)
+: map(map), start(-1), model(MapSearch::TerrainCost), stale(false)
+{
+  // initializers only
+}
+
+void DistanceField::clear()
+{
+  start = -1;
+  stale = false;
+  costs.clear();
+  reached.clear();
+  frontier.clear();
+  maxCosts.clear();
+}
+
+void DistanceField::setStart(int roomId, MapSearch::CostModel costModel)
+{
+  clear();
+  model = costModel;
+  if (!map->room(roomId)) {
+    return;
+  }
+  start = roomId;
+  recompute();
+}
+
+void DistanceField::recompute()
+{
+  costs.clear();
+  reached.clear();
+  frontier.clear();
+  maxCosts.clear();
+  stale = false;
+  const MapRoom* startRoom = map->room(start);
+  if (!startRoom) {
+    start = -1;
+    return;
+  }
+
+  QList<int> rooms = map->routeAvoidRooms();
+  avoidRooms = QSet<int>(rooms.begin(), rooms.end());
+  QStringList zones = map->routeAvoidZones();
+  avoidZones = QSet<QString>(zones.begin(), zones.end());
+  // Routes can always leave the zone they start in
+  avoidZones.remove(startRoom->zone);
+
+  std::shared_ptr<MapSearch> search = map->search();
+  if (search) {
+    costs = search->findDistances(start, {}, zones, model);
+  } else {
+    // Routing data is still being built, so search the map directly for now
+    stale = true;
+  }
+  costs[start] = 0;
+  // The snapshot can lag behind the map, so pick up anything mapped since
+  propagate(costs.keys());
+}
+
+int DistanceField::stepCost(const MapRoom* room) const
+{
+  return model == MapSearch::UniformCost ? 1 : qMax(map->roomCost(room), 1);
+}
+
+bool DistanceField::isAvoided(const MapRoom* room) const
+{
+  return avoidRooms.contains(room->id) || avoidZones.contains(room->zone);
+}
+
+void DistanceField::roomChanged(int roomId)
+{
+  if (start < 0 || stale) {
+    return;
+  }
+  const MapRoom* room = map->room(roomId);
+  auto seen = reached.constFind(roomId);
+  if (seen != reached.constEnd()) {
+    // Anything but new exits can make rooms farther away
+    if (!room || seen->stepCost != stepCost(room)) {
+      invalidate();
+      return;
+    }
+    for (int dest : seen->exits) {
+      if (!room->hasExitTo(dest)) {
+        invalidate();
+        return;
+      }
+    }
+    propagate({ roomId });
+    return;
+  }
+
+  if (!room) {
+    return;
+  }
+  auto found = frontier.find(roomId);
+  if (found != frontier.end()) {
+    // A newly mapped room behind an exit we've already reached
+    costs[roomId] = *found + stepCost(room);
+    frontier.erase(found);
+    propagate({ roomId });
+  }
+}
+
+void DistanceField::propagate(const QList<int>& roomIds)
+{
+  // Dijkstra search from rooms whose costs are already known. Costs only ever
+  // go down, so the rest of the field doesn't need to be revisited.
+  using Entry = std::pair<int, int>;
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+  for (int roomId : roomIds) {
+    queue.push({ costs.value(roomId), roomId });
+  }
+  maxCosts.clear();
+  while (!queue.empty()) {
+    auto [cost, currentId] = queue.top();
+    queue.pop();
+    if (cost > costs.value(currentId)) {
+      // stale queue entry
+      continue;
+    }
+    const MapRoom* room = map->room(currentId);
+    if (!room) {
+      // Removed since the snapshot was taken
+      costs.remove(currentId);
+      stale = true;
+      continue;
+    }
+    Reached& seen = reached[currentId];
+    seen.stepCost = stepCost(room);
+    seen.exits.clear();
+    if (currentId != start && isAvoided(room)) {
+      // Avoided rooms can be reached but not passed through
+      continue;
+    }
+    for (const MapExit& exit : room->exits) {
+      if (exit.dest < 0) {
+        continue;
+      }
+      seen.exits << exit.dest;
+      const MapRoom* next = map->room(exit.dest);
+      if (!next) {
+        auto found = frontier.find(exit.dest);
+        if (found == frontier.end() || cost < *found) {
+          frontier[exit.dest] = cost;
+        }
+        continue;
+      }
+      int newCost = cost + stepCost(next);
+      auto oldCost = costs.find(exit.dest);
+      if (oldCost == costs.end() || newCost < *oldCost) {
+        costs[exit.dest] = newCost;
+        queue.push({ newCost, exit.dest });
+      }
+    }
+  }
+}
+
+int DistanceField::maxCost(const MapZone* zone) const
+{
+  if (!zone) {
+    return 0;
+  }
+  auto iter = maxCosts.constFind(zone->name);
+  if (iter != maxCosts.constEnd()) {
+    return *iter;
+  }
+  int result = 0;
+  for (int roomId : zone->roomIds) {
+    result = qMax(result, costs.value(roomId));
+  }
+  maxCosts.insert(zone->name, result);
+  return result;
+}
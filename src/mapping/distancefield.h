@@ -0,0 +1,64 @@
+#ifndef GALOSH_DISTANCEFIELD_H
+#define GALOSH_DISTANCEFIELD_H
+
+#include <QHash>
+#include <QSet>
+#include <QVector>
+#include "mapsearch.h"
+class MapManager;
+class MapRoom;
+class MapZone;
+
+// Travel cost from one room to every room reachable from it, under the same
+// costs and avoid rules as MapSearch. The field is built from the routing
+// snapshot and then extended in place as new rooms and exits are mapped.
+// Anything that can make a room farther away rebuilds it from scratch.
+class DistanceField
+{
+public:
+  DistanceField(MapManager* map);
+
+  void setStart(int roomId, MapSearch::CostModel model);
+  void clear();
+  inline int startRoomId() const { return start; }
+  inline MapSearch::CostModel costModel() const { return model; }
+
+  // Rebuilds the field from the current routing snapshot
+  void recompute();
+  // Marks the field to be rebuilt once a routing snapshot with the change is published
+  inline void invalidate() { stale = true; }
+  inline bool isStale() const { return stale; }
+
+  // Lowers the costs of rooms that became reachable or cheaper through this room.
+  // Removed rooms, removed or repointed exits, and cost changes invalidate the field.
+  void roomChanged(int roomId);
+
+  // Returns -1 for unreachable rooms
+  inline int cost(int roomId) const { return costs.value(roomId, -1); }
+  // Cached until the field changes
+  int maxCost(const MapZone* zone) const;
+
+private:
+  int stepCost(const MapRoom* room) const;
+  bool isAvoided(const MapRoom* room) const;
+  void propagate(const QList<int>& roomIds);
+
+  MapManager* map;
+  int start;
+  MapSearch::CostModel model;
+  bool stale;
+  QHash<int, int> costs;
+  // What each reached room looked like when its cost was set, to tell growth from other changes
+  struct Reached {
+    int stepCost;
+    QVector<int> exits;
+  };
+  QHash<int, Reached> reached;
+  // Cheapest known cost of a room that has an exit to each unmapped room
+  QHash<int, int> frontier;
+  QSet<int> avoidRooms;
+  QSet<QString> avoidZones;
+  mutable QHash<QString, int> maxCosts;
+};
+
+#endif
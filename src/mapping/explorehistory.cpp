@@ -242,6 +242,18 @@ const MapRoom* ExploreHistory::currentRoom() const
   return map->room(currentRoomId);
 }
 
+QList<int> ExploreHistory::recentRooms(int count) const
+{
+  QList<int> roomIds;
+  for (int i = steps.length() - 1; i >= 0 && roomIds.length() < count; --i) {
+    int roomId = steps[i].dest;
+    if (roomId >= 0 && !roomIds.contains(roomId)) {
+      roomIds << roomId;
+    }
+  }
+  return roomIds;
+}
+
 const MapRoom* ExploreHistory::previousRoom() const
 {
   if (!canGoBack()) {
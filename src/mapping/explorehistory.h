@@ -22,6 +22,7 @@ public:
 
   const MapRoom* currentRoom() const;
   const MapRoom* previousRoom() const;
+  QList<int> recentRooms(int count) const;
 
 public slots:
   void reset();
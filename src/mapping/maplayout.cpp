@@ -9,7 +9,17 @@
 #include <QPixmap>
 #include <QLabel>
 #include <QScrollArea>
+#include <QElapsedTimer>
+#include <QSettings>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QCryptographicHash>
+#include <QtConcurrent>
 #include <QtDebug>
+#include <algorithm>
 #include <cmath>
 
 static const QStringList dirOrder{ "N", "E", "S", "W", "U", "D", "NE", "SE", "SW", "NW" };
@@ -39,6 +49,17 @@ static constexpr double EXIT_OFFSET = ROOM_SIZE / 2.0;
 static constexpr int STEP_SIZE = 10;
 static constexpr int COORD_SCALE = ROOM_SIZE + STEP_SIZE;
 static constexpr double RENDER_SCALE = 5;
+static constexpr int MAX_CONFLICTS = 5;
+static constexpr int INDEX_CELL_SIZE = 4;
+static constexpr int TILE_SIZE = 256;
+// Cache budget in kilobytes of pixel data
+static constexpr int TILE_CACHE_SIZE = 64 * 1024;
+// Room labels are drawn at 2pt and aren't legible below this zoom level
+static constexpr double LABEL_ZOOM = 3;
+// Below this zoom level only the layer outlines are drawn
+static constexpr double OUTLINE_ZOOM = 0.5;
+static constexpr quint32 CACHE_MAGIC = 0x474c4159; // "GLAY"
+static constexpr quint32 CACHE_VERSION = 1;
 static const QPointF ROOM_OFFSET(ROOM_SIZE / 2.0, ROOM_SIZE / 2.0);
 static const QSizeF ROOM_SIZEF(ROOM_SIZE, ROOM_SIZE);
 
@@ -97,55 +118,696 @@ static QPointF toEdge(const QPointF& pt)
   return QPointF(x, y);
 }
 
-MapLayout::MapLayout(MapManager* map)
-: currentZone("(none)"), map(map), search(nullptr)
+static QRectF boundingRect(const QMap<int, QPointF>& coords)
 {
-  // initializers only
+  QRectF boundingBox;
+  for (const QPointF& pos : coords) {
+    if (boundingBox.left() > pos.x()) {
+      boundingBox.setLeft(pos.x());
+    } else if (boundingBox.right() < pos.x()) {
+      boundingBox.setRight(pos.x());
+    }
+    if (boundingBox.top() > pos.y()) {
+      boundingBox.setTop(pos.y());
+    } else if (boundingBox.bottom() < pos.y()) {
+      boundingBox.setBottom(pos.y());
+    }
+  }
+  return boundingBox;
+}
+
+static QRectF displayRect(QRectF boundingBox)
+{
+  boundingBox.adjust(-1, -1, 1, 1);
+  return QRectF(boundingBox.topLeft() * COORD_SCALE, boundingBox.bottomRight() * COORD_SCALE);
+}
+
+// The geometry of an exit that tension depends on, resolved ahead of time
+struct ExitVector {
+  QPointF dir;
+  QPointF reverse;
+  bool vertical;
+  bool straight;
+};
+
+static ExitVector exitVector(int roomId, const MapRoom* dest, const QString& dir)
+{
+  QString reverse = dest->findExit(roomId);
+  if (reverse.isEmpty()) {
+    reverse = MapRoom::reverseDir(dir);
+  }
+  return (ExitVector){ dirVectors[dir], dirVectors[reverse], dir == "U" || dir == "D", reverse == MapRoom::reverseDir(dir) };
+}
+
+static double exitTension(const QPointF& startPoint, const QPointF& endPoint, const ExitVector& exit, bool weightHigh)
+{
+  QPointF step = startPoint + exit.dir * 0.25;
+  QPointF revStep = endPoint + exit.reverse * 0.25;
+  double dx = step.x() - revStep.x();
+  double dy = step.y() - revStep.y();
+  if (exit.vertical && dx >= -2 && dx <= 2) {
+    dy -= dx;
+    static constexpr double sqrt2 = std::sqrt(2);
+    dx *= sqrt2;
+  }
+  double tension = std::sqrt((dx * dx) + (dy * dy));
+  if (tension <= 1) {
+    return 0;
+  }
+  if (step.x() != revStep.x() && step.y() != revStep.y()) {
+    // nonlinearity introduces a lot of extra tension
+    // but past a certain point it stops being relevant
+    if (weightHigh) {
+      // Slightly penalize vertical distance more than horizontal
+      tension *= (dy < 0 ? 1 - dy * 0.1 : 1 + dy * 0.1);
+      double slope = dy ? qAbs(dy / dx) : 0;
+      if (slope >= 0.9 && slope <= 1.1 && (dx <= -4 || dx >= 4)) {
+        // long nearly-diagonal lines are very bad because they're highly likely to intersect rooms
+        tension *= 10;
+      }
+    } else if (tension > 15) {
+      tension *= 10;
+    } else if (tension > 3) {
+      tension = 60 + 2 * std::sqrt(tension - 3);
+    } else {
+      tension *= 20.0;
+    }
+    tension += 5;
+  }
+  // if it's supposed to be a straight connection, penalize going the wrong way
+  if (exit.straight) {
+    if (signum(int(endPoint.x() - startPoint.x())) != int(exit.dir.x())) {
+      tension *= 20 * qAbs(dx);
+    }
+    if (signum(int(endPoint.y() - startPoint.y())) != int(exit.dir.y())) {
+      tension *= 20 * qAbs(dy);
+    }
+  }
+  return tension;
+}
+
+// Summed-area table over the cells covered by a region, for constant-time
+// collision tests against translated rectangles
+class OccupancyMap
+{
+public:
+  OccupancyMap(const QRegion& region)
+  : bounds(region.boundingRect()), sums((bounds.width() + 1) * (bounds.height() + 1), 0)
+  {
+    int stride = bounds.width() + 1;
+    QVector<char> cells(bounds.width() * bounds.height(), 0);
+    for (const QRect& rect : region) {
+      for (int y = rect.top(); y <= rect.bottom(); y++) {
+        for (int x = rect.left(); x <= rect.right(); x++) {
+          cells[(y - bounds.top()) * bounds.width() + (x - bounds.left())] = 1;
+        }
+      }
+    }
+    for (int y = 0; y < bounds.height(); y++) {
+      int row = 0;
+      for (int x = 0; x < bounds.width(); x++) {
+        row += cells[y * bounds.width() + x];
+        sums[(y + 1) * stride + (x + 1)] = sums[y * stride + (x + 1)] + row;
+      }
+    }
+  }
+
+  bool intersects(const QVector<QRect>& rects, const QPoint& offset) const
+  {
+    for (const QRect& rect : rects) {
+      QRect r = rect.translated(offset) & bounds;
+      if (r.isEmpty()) {
+        continue;
+      }
+      int left = r.left() - bounds.left(), top = r.top() - bounds.top();
+      int right = r.right() + 1 - bounds.left(), bottom = r.bottom() + 1 - bounds.top();
+      if (sum(right, bottom) - sum(left, bottom) - sum(right, top) + sum(left, top) > 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+private:
+  inline int sum(int x, int y) const { return sums[y * (bounds.width() + 1) + x]; }
+
+  QRect bounds;
+  QVector<int> sums;
+};
+
+// Lays out a snapshot of a zone so the work can run off the main thread
+class MapLayout::Builder
+{
+public:
+  Builder(MapManager* map, const MapZone* zone, const std::shared_ptr<MapSearch>& search, const std::shared_ptr<std::atomic<bool>>& cancelled);
+
+  inline const QByteArray& contentHash() const { return hash; }
+  // Starts new layers from a previous layout of the zone where possible
+  void setSeed(const QList<LayerData>& previous);
+
+  void place();
+  void relaxLayer(int index);
+  void finish();
+
+  inline int layerCount() const { return layers.size(); }
+  inline bool isCancelled() const { return cancelled->load(); }
+
+  // Layers stacked vertically as they currently stand, for progressive display
+  Result preview() const;
+  Result result() const;
+
+private:
+  struct CliqueData {
+    QSet<int> roomIds;
+    int startRoomId;
+  };
+
+  const MapRoom* findRoom(int roomId) const;
+
+  void loadClique(const CliqueData& clique, int roomId, int zIndex);
+  void applySeed();
+  void relattice();
+  void markPathPoints();
+  void relax();
+  // Moves rooms to reduce exit tension, returning true if anything moved
+  bool relaxTension();
+  void calculateRegion(LayerData& layer);
+
+  double tension(int roomId, int destRoomId, const QString& dir, const QMap<int, QPointF>& substitutions = {}, bool weightHigh = false) const;
+  // With fixedOnly, exits to or from substituted rooms are left out
+  double tension(int roomId, const QMap<int, QPointF>& substitutions = {}, bool weightHigh = false, bool fixedOnly = false) const;
+  double tension(const QMap<int, QPointF>& substitutions = {}) const;
+
+  LayerData* findLayer(int roomId);
+
+  QString zone;
+  QHash<int, MapRoom> rooms;
+  QList<CliqueData> cliques;
+  std::shared_ptr<std::atomic<bool>> cancelled;
+  QByteArray hash;
+  QList<QMap<int, QPointF>> seedLayers;
+
+  QRectF boundingBox;
+  QMap<int, QPointF> coords;
+  QMap<int, int> roomLayers;
+  QHash<QPair<int, int>, int> coordsRev;
+  QMap<QPair<int, int>, QSet<int>> pathPoints;
+  QMap<int, QSet<int>> oneWayExits;
+  QMap<QPair<int, QString>, int> zoneExits;
+  QList<LayerData> layers;
+  QMap<int, int> pendingLayers;
+};
+
+MapLayout::MapLayout(MapManager* map, QObject* parent)
+: QObject(parent), currentZone("(none)"), tiles(TILE_CACHE_SIZE), map(map), cancelled(new std::atomic<bool>(false)),
+  generation(0), stale(false), conflicts(0)
+{
+  QObject::connect(map, SIGNAL(searchUpdated()), this, SLOT(searchUpdated()));
+}
+
+MapLayout::~MapLayout()
+{
+  cancel();
+  for (QFuture<void>& job : jobs) {
+    job.waitForFinished();
+  }
+}
+
+void MapLayout::cancel()
+{
+  *cancelled = true;
+  cancelled.reset(new std::atomic<bool>(false));
+  ++generation;
 }
 
 void MapLayout::loadZone(const MapZone* zone, bool force)
 {
   if (zone) {
-    search = map->search();
-    if (!search->precompute(force)) {
-      // If no changes occurred in the search computation,
-      // it's safe to short-circuit and keep what we have,
-      // assuming we aren't moving to a new zone.
-      if (currentZone == zone->name) {
+    std::shared_ptr<MapSearch> latest = map->search();
+    if (!latest) {
+      // The routing data isn't built yet. searchUpdated() lays the zone out once it is.
+      cancel();
+      search.reset();
+      currentZone = zone->name;
+      applyResult(generation, Result());
+      return;
+    }
+    if ((latest == search || !stale) && !force && currentZone == zone->name) {
+      // If the search snapshot hasn't changed, or every change to
+      // this zone has already been placed incrementally, it's safe
+      // to short-circuit and keep what we have, assuming we aren't
+      // moving to a new zone.
+      search = latest;
+      return;
+    }
+    search = latest;
+  }
+
+  cancel();
+  stale = false;
+  conflicts = 0;
+  if (!zone) {
+    currentZone.clear();
+    applyResult(generation, Result());
+    return;
+  }
+
+  currentZone = zone->name;
+
+  std::shared_ptr<Builder> builder(new Builder(map, zone, search, cancelled));
+  QString cachePath = cacheFile(zone->name);
+  QByteArray cachedHash;
+  Result cached;
+  if (readCache(cachePath, zone->name, &cachedHash, &cached)) {
+    if (cachedHash == builder->contentHash()) {
+      applyResult(generation, cached);
+      return;
+    }
+    builder->setSeed(cached.layers);
+  }
+
+  // Show a rough placement right away and refine it in the background
+  builder->place();
+  applyResult(generation, builder->preview());
+
+  quint64 gen = generation;
+  jobs.erase(std::remove_if(jobs.begin(), jobs.end(), [](const QFuture<void>& job) { return job.isFinished(); }), jobs.end());
+  jobs << QtConcurrent::run([this, builder, gen, cachePath]{
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < builder->layerCount(); i++) {
+      builder->relaxLayer(i);
+      if (builder->isCancelled()) {
         return;
       }
+      if (timer.elapsed() > 250) {
+        Result preview = builder->preview();
+        QMetaObject::invokeMethod(this, [this, gen, preview]{ applyResult(gen, preview); }, Qt::QueuedConnection);
+        timer.restart();
+      }
     }
-  } else {
-    currentZone.clear();
+    builder->finish();
+    if (builder->isCancelled()) {
+      return;
+    }
+    Result result = builder->result();
+    writeCache(cachePath, result.title, builder->contentHash(), result);
+    QMetaObject::invokeMethod(this, [this, gen, result]{ applyResult(gen, result); }, Qt::QueuedConnection);
+  });
+}
+
+void MapLayout::searchUpdated()
+{
+  const MapZone* zone = map->zone(currentZone);
+  if (!search && zone) {
+    // A zone was requested before there was anything to lay it out from
+    loadZone(zone, true);
   }
+}
 
-  coords.clear();
-  roomLayers.clear();
-  coordsRev.clear();
-  pathPoints.clear();
-  oneWayExits.clear();
-  layers.clear();
-  pendingLayers.clear();
-  boundingBox = QRectF();
+void MapLayout::applyResult(quint64 gen, const Result& result)
+{
+  if (gen != generation) {
+    // A newer layout has been requested since this one started
+    return;
+  }
+  title = result.title;
+  boundingBox = result.boundingBox;
+  coords = result.coords;
+  coordsRev = result.coordsRev;
+  layers = result.layers;
+  index.cells.clear();
+  styles.clear();
+  tiles.clear();
+  for (int roomId : keys(coords)) {
+    indexRoom(roomId);
+    updateStyle(roomId);
+  }
+  emit layoutUpdated();
+}
 
-  if (!zone) {
+void MapLayout::updateStyle(int roomId)
+{
+  QColor color = map->roomColor(roomId);
+  styles[roomId] = (RoomStyle){ color.isValid() ? color : QColor(Qt::white), QString::number(roomId % 100) };
+}
+
+void MapLayout::invalidateStyles()
+{
+  for (int roomId : keys(coords)) {
+    updateStyle(roomId);
+  }
+  tiles.clear();
+  emit layoutUpdated();
+}
+
+void MapLayout::invalidateTiles(int roomId)
+{
+  QRectF bounds;
+  const MapRoom* room = map->room(roomId);
+  QPointF pos = coords.value(roomId);
+  bounds = QRectF(pos, pos);
+  if (room) {
+    for (const MapExit& exit : room->exits) {
+      auto iter = coords.constFind(exit.dest);
+      if (iter != coords.constEnd()) {
+        bounds = bounds.united(QRectF(*iter, *iter));
+      }
+    }
+  }
+  bounds = QRectF(bounds.topLeft() * COORD_SCALE, bounds.bottomRight() * COORD_SCALE).translated(-boundingBox.topLeft());
+  bounds.adjust(-COORD_SCALE, -COORD_SCALE, COORD_SCALE, COORD_SCALE);
+  for (const TileKey& key : tiles.keys()) {
+    double zoom = key.zoom / 1024.0;
+    QRectF tile(key.x * TILE_SIZE / zoom, key.y * TILE_SIZE / zoom, TILE_SIZE / zoom, TILE_SIZE / zoom);
+    if (tile.intersects(bounds)) {
+      tiles.remove(key);
+    }
+  }
+}
+
+void MapLayout::indexRoom(int roomId)
+{
+  const MapRoom* room = map->room(roomId);
+  QPointF pos = coords.value(roomId);
+  QRectF bounds(pos, pos);
+  if (room) {
+    for (const MapExit& exit : room->exits) {
+      auto iter = coords.constFind(exit.dest);
+      if (iter != coords.constEnd()) {
+        bounds = bounds.united(QRectF(*iter, *iter));
+      }
+    }
+  }
+  // Leave room for the room itself, exit stubs and curved exit lines
+  index.insert(roomId, bounds.adjusted(-1, -1, 1, 1));
+}
+
+void MapLayout::SpatialIndex::insert(int roomId, const QRectF& bounds)
+{
+  int x0 = std::floor(bounds.left() / INDEX_CELL_SIZE), x1 = std::floor(bounds.right() / INDEX_CELL_SIZE);
+  int y0 = std::floor(bounds.top() / INDEX_CELL_SIZE), y1 = std::floor(bounds.bottom() / INDEX_CELL_SIZE);
+  for (int y = y0; y <= y1; y++) {
+    for (int x = x0; x <= x1; x++) {
+      cells[qMakePair(x, y)] << roomId;
+    }
+  }
+}
+
+QVector<int> MapLayout::SpatialIndex::query(const QRectF& bounds) const
+{
+  int x0 = std::floor(bounds.left() / INDEX_CELL_SIZE), x1 = std::floor(bounds.right() / INDEX_CELL_SIZE);
+  int y0 = std::floor(bounds.top() / INDEX_CELL_SIZE), y1 = std::floor(bounds.bottom() / INDEX_CELL_SIZE);
+  QVector<int> roomIds;
+  for (int y = y0; y <= y1; y++) {
+    for (int x = x0; x <= x1; x++) {
+      auto iter = cells.constFind(qMakePair(x, y));
+      if (iter != cells.constEnd()) {
+        roomIds += *iter;
+      }
+    }
+  }
+  std::sort(roomIds.begin(), roomIds.end());
+  roomIds.erase(std::unique(roomIds.begin(), roomIds.end()), roomIds.end());
+  return roomIds;
+}
+
+void MapLayout::roomChanged(int roomId)
+{
+  if (currentZone.isEmpty() || coords.isEmpty() || stale) {
     return;
   }
+  const MapRoom* room = map->room(roomId);
+  if (coords.contains(roomId)) {
+    // Exits are drawn from the live map data, so placed rooms stay pinned
+    // unless they have been removed or moved to another zone.
+    if (!room || room->zone != currentZone) {
+      stale = true;
+    } else {
+      updateStyle(roomId);
+      invalidateTiles(roomId);
+    }
+    return;
+  }
+  if (!room || room->zone != currentZone) {
+    return;
+  }
+  if ((!jobs.isEmpty() && jobs.last().isRunning()) || !placeRoom(room) || conflicts > MAX_CONFLICTS) {
+    // Let the next call to loadZone redo the whole zone
+    stale = true;
+  }
+}
 
-  currentZone = zone->name;
+bool MapLayout::placeRoom(const MapRoom* room)
+{
+  // Start from the position implied by the direction the room was entered from
+  QPointF start;
+  int anchorId = -1;
+  for (auto [dir, exit] : cpairs(room->exits)) {
+    const MapRoom* anchor = map->room(exit.dest);
+    if (!anchor || !coords.contains(exit.dest)) {
+      continue;
+    }
+    QString anchorDir = anchor->findExit(room->id);
+    if (anchorDir.isEmpty()) {
+      anchorDir = MapRoom::reverseDir(dir);
+    }
+    anchorId = exit.dest;
+    start = coords[exit.dest] + dirVectors.value(anchorDir);
+    if (!anchor->findExit(room->id).isEmpty()) {
+      break;
+    }
+  }
+  if (anchorId < 0) {
+    return false;
+  }
 
-  QMap<QPair<int, QString>, int> zoneExits;
-  oneWayExits.clear();
+  // Relax only within a small neighbourhood of the starting point
+  static const QPointF offsetSteps[] = {
+    { 0, 0 },
+    { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 },
+    { -1, -1 }, { 1, -1 }, { -1, 1 }, { 1, 1 },
+    { -2, 0 }, { 2, 0 }, { 0, -2 }, { 0, 2 },
+  };
+  double bestTension = -1;
+  QPointF bestPoint;
+  for (const QPointF& offset : offsetSteps) {
+    QPointF pt = start + offset;
+    if (coordsRev.contains(pointToPair(pt)) || isOnPath(pt)) {
+      continue;
+    }
+    double t = 0;
+    for (auto [dir, exit] : cpairs(room->exits)) {
+      if (coords.contains(exit.dest)) {
+        t += magSqr(coords[exit.dest] - (pt + dirVectors.value(dir)));
+      }
+    }
+    if (bestTension < 0 || t < bestTension) {
+      bestTension = t;
+      bestPoint = pt;
+    }
+  }
+  if (bestTension < 0) {
+    return false;
+  }
+  if (bestTension > 0) {
+    ++conflicts;
+  }
+
+  coords[room->id] = bestPoint;
+  coordsRev[pointToPair(bestPoint)] = room->id;
+  indexRoom(room->id);
+  updateStyle(room->id);
+  for (LayerData& layer : layers) {
+    if (layer.coords.contains(anchorId)) {
+      layer.coords[room->id] = bestPoint;
+      break;
+    }
+  }
+  QPointF pos = bestPoint * COORD_SCALE;
+  QRectF oldBox = boundingBox;
+  boundingBox = boundingBox.united(QRectF(pos - QPointF(COORD_SCALE, COORD_SCALE), QSizeF(COORD_SCALE * 2, COORD_SCALE * 2)));
+  if (boundingBox.topLeft() != oldBox.topLeft()) {
+    // Everything moved on screen
+    tiles.clear();
+  } else {
+    invalidateTiles(room->id);
+  }
+  emit layoutUpdated();
+  return true;
+}
+
+bool MapLayout::isOnPath(const QPointF& pt) const
+{
+  // Only straight lines between nearby rooms can pass through the point
+  for (int dy = -2; dy <= 2; dy++) {
+    for (int dx = -2; dx <= 2; dx++) {
+      int roomId = coordsRev.value(pointToPair(pt + QPointF(dx, dy)), -1);
+      const MapRoom* room = roomId > 0 ? map->room(roomId) : nullptr;
+      if (!room || !coords.contains(roomId)) {
+        continue;
+      }
+      QPointF from = coords.value(roomId);
+      for (const MapExit& exit : room->exits) {
+        if (!coords.contains(exit.dest)) {
+          continue;
+        }
+        QPointF along = pt - from;
+        QPointF to = coords[exit.dest] - from;
+        double cross = along.x() * to.y() - along.y() * to.x();
+        double dot = along.x() * to.x() + along.y() * to.y();
+        if (cross == 0 && dot > 0 && dot < magSqr(to)) {
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+QString MapLayout::cacheFile(const QString& zone) const
+{
+  QSettings* mapFile = map->mapProfile();
+  if (!mapFile) {
+    return QString();
+  }
+  QDir dir(mapFile->fileName() + "_layouts");
+  QByteArray key = QCryptographicHash::hash(zone.toUtf8(), QCryptographicHash::Sha1).toHex();
+  return dir.absoluteFilePath(QString::fromLatin1(key) + ".layout");
+}
+
+bool MapLayout::readCache(const QString& path, const QString& zone, QByteArray* hash, Result* result)
+{
+  QFile file(path);
+  if (path.isEmpty() || !file.open(QIODevice::ReadOnly)) {
+    return false;
+  }
+  QDataStream ds(&file);
+  ds.setVersion(QDataStream::Qt_5_12);
+  quint32 magic, version;
+  QString cachedZone;
+  ds >> magic >> version;
+  if (magic != CACHE_MAGIC || version != CACHE_VERSION) {
+    return false;
+  }
+  ds >> cachedZone >> *hash;
+  if (cachedZone != zone) {
+    return false;
+  }
+  qint32 layerCount;
+  ds >> result->title >> result->boundingBox >> result->coords >> result->coordsRev >> layerCount;
+  for (int i = 0; i < layerCount && ds.status() == QDataStream::Ok; i++) {
+    qint32 source, zIndex;
+    LayerData layer;
+    ds >> source >> layer.coords >> layer.boundingBox >> zIndex >> layer.region >> layer.polygon >> layer.layerExits;
+    layer.source = source;
+    layer.zIndex = zIndex;
+    result->layers << layer;
+  }
+  return ds.status() == QDataStream::Ok;
+}
+
+void MapLayout::writeCache(const QString& path, const QString& zone, const QByteArray& hash, const Result& result)
+{
+  if (path.isEmpty() || !QDir().mkpath(QFileInfo(path).path())) {
+    return;
+  }
+  QSaveFile file(path);
+  if (!file.open(QIODevice::WriteOnly)) {
+    qWarning() << "Unable to write layout cache" << path;
+    return;
+  }
+  QDataStream ds(&file);
+  ds.setVersion(QDataStream::Qt_5_12);
+  ds << CACHE_MAGIC << CACHE_VERSION << zone << hash;
+  ds << result.title << result.boundingBox << result.coords << result.coordsRev << qint32(result.layers.size());
+  for (const LayerData& layer : result.layers) {
+    ds << qint32(layer.source) << layer.coords << layer.boundingBox << qint32(layer.zIndex) << layer.region << layer.polygon << layer.layerExits;
+  }
+  file.commit();
+}
+
+MapLayout::Builder::Builder(MapManager* map, const MapZone* zone, const std::shared_ptr<MapSearch>& search, const std::shared_ptr<std::atomic<bool>>& cancelled)
+: zone(zone->name), cancelled(cancelled)
+{
+  QList<int> startRoomIds;
   for (MapSearch::Clique::RefR clique : search->cliquesForZone(zone)) {
+    int startRoomId = -1;
+    for (const auto& exit : clique->exits) {
+      if (startRoomId < 0 || exit.fromRoomId < startRoomId) {
+        startRoomId = exit.fromRoomId;
+      }
+    }
+    if (startRoomId < 0) {
+      for (int id : clique->roomIds) {
+        if (startRoomId < 0 || id < startRoomId) {
+          startRoomId = id;
+        }
+      }
+    }
+    cliques << (CliqueData){ clique->roomIds, startRoomId };
+    startRoomIds << startRoomId;
+
     for (int roomId : clique->roomIds) {
       const MapRoom* room = map->room(roomId);
       if (!room) {
         continue;
       }
-      for (auto [dir, exit] : cpairs(room->exits)) {
+      rooms[roomId] = *room;
+      for (const MapExit& exit : room->exits) {
         const MapRoom* dest = map->room(exit.dest);
-        if (!clique->roomIds.contains(exit.dest)) {
-          if (dest && dest->zone != zone->name) {
+        if (dest && !rooms.contains(exit.dest)) {
+          rooms[exit.dest] = *dest;
+        }
+      }
+    }
+  }
+
+  QByteArray data;
+  QDataStream ds(&data, QIODevice::WriteOnly);
+  std::sort(startRoomIds.begin(), startRoomIds.end());
+  ds << startRoomIds;
+  QList<int> roomIds = rooms.keys();
+  std::sort(roomIds.begin(), roomIds.end());
+  for (int roomId : roomIds) {
+    const MapRoom& room = rooms[roomId];
+    ds << roomId << room.zone;
+    for (auto [dir, exit] : cpairs(room.exits)) {
+      ds << dir << exit.dest;
+    }
+  }
+  hash = QCryptographicHash::hash(data, QCryptographicHash::Sha1);
+}
+
+void MapLayout::Builder::setSeed(const QList<LayerData>& previous)
+{
+  seedLayers.clear();
+  for (const LayerData& layer : previous) {
+    seedLayers << layer.coords;
+  }
+}
+
+const MapRoom* MapLayout::Builder::findRoom(int roomId) const
+{
+  auto iter = rooms.constFind(roomId);
+  if (iter == rooms.constEnd()) {
+    return nullptr;
+  }
+  return &*iter;
+}
+
+void MapLayout::Builder::place()
+{
+  for (const CliqueData& clique : cliques) {
+    for (int roomId : clique.roomIds) {
+      const MapRoom* room = findRoom(roomId);
+      if (!room) {
+        continue;
+      }
+      for (auto [dir, exit] : cpairs(room->exits)) {
+        const MapRoom* dest = findRoom(exit.dest);
+        if (!clique.roomIds.contains(exit.dest)) {
+          if (dest && dest->zone != zone) {
             zoneExits[qMakePair(roomId, dir)] = exit.dest;
           }
           continue;
@@ -155,32 +817,15 @@ void MapLayout::loadZone(const MapZone* zone, bool force)
         }
       }
     }
+  }
 
+  for (auto [index, clique] : enumerate(cliques)) {
     coords.clear();
     coordsRev.clear();
-    boundingBox = QRectF();
-    int roomId = -1;
-    for (const auto& exit : clique->exits) {
-      if (roomId < 0 || exit.fromRoomId < roomId) {
-        roomId = exit.fromRoomId;
-      }
-    }
-    if (roomId < 0) {
-      for (int id : clique->roomIds) {
-        if (roomId < 0 || id < roomId) {
-          roomId = id;
-        }
-      }
-    }
-
-    if (boundingBox.isEmpty()) {
-      coords[roomId] = QPointF(1, 1);
-    } else {
-      coords[roomId] = QPointF(boundingBox.right() + 5, 1);
-    }
-    loadClique(clique, roomId, 0);
-    relax();
-    layers << (LayerData){ clique, coords, boundingBox, 0, {}, {}, {} };
+    coords[clique.startRoomId] = QPointF(1, 1);
+    loadClique(clique, clique.startRoomId, 0);
+    applySeed();
+    layers << (LayerData){ index, coords, boundingRect(coords), 0, {}, {}, {} };
 
     do {
       auto layersCopy = pendingLayers;
@@ -191,15 +836,83 @@ void MapLayout::loadZone(const MapZone* zone, bool force)
         }
         coords.clear();
         coordsRev.clear();
-        boundingBox = QRectF();
         coords[startRoomId] = QPointF(1, 1);
         loadClique(clique, startRoomId, zIndex);
-        relax();
-        layers << (LayerData){ clique, coords, boundingBox, zIndex, {}, {}, {} };
+        applySeed();
+        layers << (LayerData){ index, coords, boundingRect(coords), zIndex, {}, {}, {} };
       }
     } while (!pendingLayers.isEmpty());
   }
+}
+
+void MapLayout::Builder::applySeed()
+{
+  // Use the cached layer that shares the most rooms with this one
+  const QMap<int, QPointF>* seed = nullptr;
+  int seedCount = 0;
+  for (const QMap<int, QPointF>& layer : seedLayers) {
+    int count = 0;
+    for (int roomId : keys(coords)) {
+      if (layer.contains(roomId)) {
+        ++count;
+      }
+    }
+    if (count > seedCount) {
+      seed = &layer;
+      seedCount = count;
+    }
+  }
+  if (!seed) {
+    return;
+  }
 
+  QMap<int, QPointF> seeded;
+  QSet<QPair<int, int>> used;
+  QList<int> queue;
+  for (int roomId : keys(coords)) {
+    if (seed->contains(roomId)) {
+      QPointF pos = seed->value(roomId);
+      seeded[roomId] = pos;
+      used << pointToPair(pos);
+      queue << roomId;
+    }
+  }
+  // New rooms start out next to the room they were reached from
+  while (!queue.isEmpty()) {
+    int roomId = queue.takeFirst();
+    QPointF pos = seeded[roomId];
+    for (auto [dir, exit] : cpairs(findRoom(roomId)->exits)) {
+      if (!coords.contains(exit.dest) || seeded.contains(exit.dest)) {
+        continue;
+      }
+      QPointF nextPos = pos + dirVectors.value(dir, QPointF(0.1, 0.1));
+      auto rev = pointToPair(nextPos);
+      while (used.contains(rev)) {
+        nextPos = (nextPos + pos) / 2;
+        rev = pointToPair(nextPos);
+      }
+      seeded[exit.dest] = nextPos;
+      used << rev;
+      queue << exit.dest;
+    }
+  }
+  if (seeded.size() == coords.size()) {
+    coords = seeded;
+  }
+}
+
+void MapLayout::Builder::relaxLayer(int index)
+{
+  LayerData& layer = layers[index];
+  coords = layer.coords;
+  coordsRev.clear();
+  relax();
+  layer.coords = coords;
+  layer.boundingBox = boundingBox;
+}
+
+void MapLayout::Builder::finish()
+{
   coords.clear();
   coordsRev.clear();
   boundingBox = QRectF();
@@ -209,12 +922,12 @@ void MapLayout::loadZone(const MapZone* zone, bool force)
       QPointF pos = layer.coords[roomId] + offset;
       layer.coords[roomId] = coords[roomId] = pos;
       coordsRev[pointToPair(pos)] = roomId;
-      for (const MapExit& exit : map->room(roomId)->exits) {
+      for (const MapExit& exit : findRoom(roomId)->exits) {
         if (layer.coords.contains(exit.dest)) {
           continue;
         }
-        const MapRoom* dest = map->room(exit.dest);
-        if (dest && dest->zone == zone->name) {
+        const MapRoom* dest = findRoom(exit.dest);
+        if (dest && dest->zone == zone) {
           layer.layerExits << qMakePair(roomId, exit.dest);
         }
       }
@@ -235,11 +948,14 @@ void MapLayout::loadZone(const MapZone* zone, bool force)
   }
 
   QList<LayerData*> done;
-  QSet<Clique::Ref> rootCliques;
+  QSet<int> rootCliques;
   QRect bb;
   QRegion locked;
   while (done.size() < layers.size()) {
     for (LayerData& layer : layers) {
+      if (isCancelled()) {
+        return;
+      }
       if (done.contains(&layer)) {
         continue;
       }
@@ -268,25 +984,52 @@ void MapLayout::loadZone(const MapZone* zone, bool force)
       int x1 = x0 + bb.width() + layerBB.width() + 3;
       int y0 = -(layerBB.top() - bb.top()) - layerBB.height() - 1;
       int y1 = y0 + bb.height() + layerBB.height() + 3;
-      int bestTension = -1;
-      QPointF bestPos;
+
+      // Visit the candidates nearest first, keeping scan order for ties so
+      // the same placement wins as with a full scan
+      QVector<QPoint> candidates;
+      candidates.reserve((x1 - x0 + 1) * (y1 - y0 + 1));
       for (int y = y0; y <= y1; y++) {
         for (int x = x0; x <= x1; x++) {
-          if (layer.region.translated(x, y).intersects(locked)) {
-            continue;
-          }
-          QPointF offset(x, y);
-          QMap<int, QPointF> substitutions;
-          for (auto [ fromId, _ ] : tensionRooms) {
-            substitutions[fromId] = layer.coords[fromId] + offset;
-          }
-          int t = 0;
-          for (auto [ _, toId ] : tensionRooms) {
-            t += tension(toId, substitutions, true);
-          }
-          if (bestTension < 0 || bestTension > t || (bestTension == t && magSqr(offset) < magSqr(bestPos))) {
-            bestTension = t;
-            bestPos = offset;
+          candidates << QPoint(x, y);
+        }
+      }
+      std::stable_sort(candidates.begin(), candidates.end(), [](const QPoint& lhs, const QPoint& rhs) {
+        return lhs.x() * lhs.x() + lhs.y() * lhs.y() < rhs.x() * rhs.x() + rhs.y() * rhs.y();
+      });
+
+      QMap<int, QPointF> substitutions;
+      for (auto [ fromId, _ ] : tensionRooms) {
+        substitutions[fromId] = layer.coords[fromId];
+      }
+      // Exits that don't leave this layer contribute the same tension
+      // everywhere, so no candidate can do better than that
+      int minTension = 0;
+      for (auto [ _, toId ] : tensionRooms) {
+        minTension += tension(toId, substitutions, true, true);
+      }
+
+      OccupancyMap occupied(locked);
+      QVector<QRect> layerRects(layer.region.begin(), layer.region.end());
+      int bestTension = -1;
+      QPointF bestPos;
+      for (const QPoint& candidate : candidates) {
+        if (occupied.intersects(layerRects, candidate)) {
+          continue;
+        }
+        QPointF offset(candidate);
+        for (auto iter = substitutions.begin(); iter != substitutions.end(); ++iter) {
+          iter.value() = layer.coords[iter.key()] + offset;
+        }
+        int t = 0;
+        for (auto [ _, toId ] : tensionRooms) {
+          t += tension(toId, substitutions, true);
+        }
+        if (bestTension < 0 || bestTension > t || (bestTension == t && magSqr(offset) < magSqr(bestPos))) {
+          bestTension = t;
+          bestPos = offset;
+          if (bestTension <= minTension) {
+            break;
           }
         }
       }
@@ -308,9 +1051,7 @@ void MapLayout::loadZone(const MapZone* zone, bool force)
     break;
   }
 
-  calculateBoundingBox();
-  boundingBox.adjust(-1, -1, 1, 1);
-  boundingBox = QRectF(boundingBox.topLeft() * COORD_SCALE, boundingBox.bottomRight() * COORD_SCALE);
+  boundingBox = displayRect(boundingRect(coords));
 
   // update final coordinates
   coords.clear();
@@ -327,15 +1068,40 @@ void MapLayout::loadZone(const MapZone* zone, bool force)
     auto [roomId, dir] = pair;
     coordsRev[pointToPair(coords.value(roomId) + dirVectors[dir] * 0.75)] = destRoomId;
   }
+}
 
-  title = zone->name;
+MapLayout::Result MapLayout::Builder::preview() const
+{
+  Result preview;
+  preview.title = zone;
+  QPointF offset;
+  for (const LayerData& layer : layers) {
+    LayerData placed = layer;
+    for (auto [roomId, pos] : pairs(placed.coords)) {
+      pos += offset;
+      preview.coords[roomId] = pos;
+      preview.coordsRev[pointToPair(pos)] = roomId;
+    }
+    offset.ry() += layer.boundingBox.height() + 1;
+    preview.layers << placed;
+  }
+  preview.boundingBox = displayRect(boundingRect(preview.coords));
+  return preview;
 }
 
-void MapLayout::loadClique(MapSearch::Clique::RefR clique, int roomId, int zIndex)
+MapLayout::Result MapLayout::Builder::result() const
 {
-  const MapRoom* room = map->room(roomId);
-  if (room->zone != currentZone) {
-    qWarning() << "XXX: mismatch in loadClique: room" << roomId << "in" << room->zone << "not" << currentZone;
+  return (Result){ zone, boundingBox, coords, coordsRev, layers };
+}
+
+void MapLayout::Builder::loadClique(const CliqueData& clique, int roomId, int zIndex)
+{
+  const MapRoom* room = findRoom(roomId);
+  if (!room) {
+    return;
+  }
+  if (room->zone != zone) {
+    qWarning() << "XXX: mismatch in loadClique: room" << roomId << "in" << room->zone << "not" << zone;
     return;
   }
   if (roomLayers.contains(roomId)) {
@@ -346,14 +1112,14 @@ void MapLayout::loadClique(MapSearch::Clique::RefR clique, int roomId, int zInde
   }
   roomLayers[roomId] = zIndex;
   for (auto [ dir, exit ] : cpairs(room->exits)) {
-    if (!clique->roomIds.contains(exit.dest)) {
+    if (!clique.roomIds.contains(exit.dest)) {
       continue;
     }
     QPointF pos = coords.value(roomId);
     int dest = exit.dest;
     int newZIndex = zIndex;
     if (dir == "U" || dir == "D") {
-      const MapRoom* destRoom = map->room(dest);
+      const MapRoom* destRoom = findRoom(dest);
       if (!destRoom) {
         continue;
       }
@@ -371,7 +1137,7 @@ void MapLayout::loadClique(MapSearch::Clique::RefR clique, int roomId, int zInde
         continue;
       }
     }
-    if (!clique->roomIds.contains(dest)) {
+    if (!clique.roomIds.contains(dest)) {
       continue;
     }
     QPointF nextPos = pos + dirVectors.value(dir, QPointF(0.1, 0.1));
@@ -389,94 +1155,32 @@ void MapLayout::loadClique(MapSearch::Clique::RefR clique, int roomId, int zInde
   }
 }
 
-void MapLayout::calculateBoundingBox()
-{
-  boundingBox = QRectF();
-  for (const QPointF& pos : coords) {
-    if (boundingBox.left() > pos.x()) {
-      boundingBox.setLeft(pos.x());
-    } else if (boundingBox.right() < pos.x()) {
-      boundingBox.setRight(pos.x());
-    }
-    if (boundingBox.top() > pos.y()) {
-      boundingBox.setTop(pos.y());
-    } else if (boundingBox.bottom() < pos.y()) {
-      boundingBox.setBottom(pos.y());
-    }
-  }
-}
-
-double MapLayout::tension(int roomId, int destRoomId, const QString& dir, const QMap<int, QPointF>& substitutions, bool weightHigh) const
+double MapLayout::Builder::tension(int roomId, int destRoomId, const QString& dir, const QMap<int, QPointF>& substitutions, bool weightHigh) const
 {
   if (!coords.contains(destRoomId)) {
     return -1;
   }
-  const MapRoom* dest = map->room(destRoomId);
   QPointF startPoint = substitutions.value(roomId, coords[roomId]);
   QPointF endPoint = substitutions.value(destRoomId, coords[destRoomId]);
-  QString reverse = dest->findExit(roomId);
-  if (reverse.isEmpty()) {
-    reverse = MapRoom::reverseDir(dir);
-  }
-  QPointF step = startPoint + dirVectors[dir] * 0.25;
-  QPointF revStep = endPoint + dirVectors[reverse] * 0.25;
-  double dx = step.x() - revStep.x();
-  double dy = step.y() - revStep.y();
-  bool diagonal = (dir == "U" || dir == "D");
-  if (diagonal && dx >= -2 && dx <= 2) {
-    dy -= dx;
-    static constexpr double sqrt2 = std::sqrt(2);
-    dx *= sqrt2;
-  }
-  double tension = std::sqrt((dx * dx) + (dy * dy));
-  if (tension <= 1) {
-    return 0;
-  }
-  if (step.x() != revStep.x() && step.y() != revStep.y()) {
-    // nonlinearity introduces a lot of extra tension
-    // but past a certain point it stops being relevant
-    if (weightHigh) {
-      // Slightly penalize vertical distance more than horizontal
-      tension *= (dy < 0 ? 1 - dy * 0.1 : 1 + dy * 0.1);
-      double slope = dy ? qAbs(dy / dx) : 0;
-      if (slope >= 0.9 && slope <= 1.1 && (dx <= -4 || dx >= 4)) {
-        // long nearly-diagonal lines are very bad because they're highly likely to intersect rooms
-        tension *= 10;
-      }
-    } else if (tension > 15) {
-      tension *= 10;
-    } else if (tension > 3) {
-      tension = 60 + 2 * std::sqrt(tension - 3);
-    } else {
-      tension *= 20.0;
-    }
-    tension += 5;
-  }
-  // if it's supposed to be a straight connection, penalize going the wrong way
-  if (reverse == MapRoom::reverseDir(dir)) {
-    if (signum(int(endPoint.x() - startPoint.x())) != int(dirVectors[dir].x())) {
-      tension *= 20 * qAbs(dx);
-    }
-    if (signum(int(endPoint.y() - startPoint.y())) != int(dirVectors[dir].y())) {
-      tension *= 20 * qAbs(dy);
-    }
-  }
-  return tension;
+  return exitTension(startPoint, endPoint, exitVector(roomId, findRoom(destRoomId), dir), weightHigh);
 }
 
-double MapLayout::tension(int roomId, const QMap<int, QPointF>& substitutions, bool weightHigh) const
+double MapLayout::Builder::tension(int roomId, const QMap<int, QPointF>& substitutions, bool weightHigh, bool fixedOnly) const
 {
   double total = 0;
-  const MapRoom* room = map->room(roomId);
+  const MapRoom* room = findRoom(roomId);
   for (auto [ dir, exit ] : cpairs(room->exits)) {
+    if (fixedOnly && substitutions.contains(exit.dest)) {
+      continue;
+    }
     int t = tension(roomId, exit.dest, dir, substitutions, weightHigh);
     if (t > 0) {
       total += t;
     }
   }
   for (int sourceRoomId : oneWayExits.value(roomId)) {
-    const MapRoom* source = map->room(sourceRoomId);
-    if (!source) {
+    const MapRoom* source = findRoom(sourceRoomId);
+    if (!source || (fixedOnly && substitutions.contains(sourceRoomId))) {
       continue;
     }
     int t = tension(roomId, sourceRoomId, MapRoom::reverseDir(source->findExit(roomId)), substitutions, weightHigh);
@@ -487,7 +1191,7 @@ double MapLayout::tension(int roomId, const QMap<int, QPointF>& substitutions, b
   return total;
 }
 
-double MapLayout::tension(const QMap<int, QPointF>& substitutions) const
+double MapLayout::Builder::tension(const QMap<int, QPointF>& substitutions) const
 {
   double total = 0;
   for (int roomId : keys(coords)) {
@@ -496,7 +1200,7 @@ double MapLayout::tension(const QMap<int, QPointF>& substitutions) const
   return total;
 }
 
-void MapLayout::relattice()
+void MapLayout::Builder::relattice()
 {
   // Find X and Y values that are in use
   QSet<double> xValues, yValues;
@@ -535,11 +1239,11 @@ void MapLayout::relattice()
   markPathPoints();
 }
 
-void MapLayout::markPathPoints()
+void MapLayout::Builder::markPathPoints()
 {
   pathPoints.clear();
   for (auto [ roomId, startPoint ] : pairs(coords)) {
-    const MapRoom* room = map->room(roomId);
+    const MapRoom* room = findRoom(roomId);
     for (auto [ dir, exit ] : cpairs(room->exits)) {
       int destId = exit.dest;
       if (!coords.contains(destId)) {
@@ -578,11 +1282,14 @@ void MapLayout::markPathPoints()
   }
 }
 
-void MapLayout::relax()
+void MapLayout::Builder::relax()
 {
   bool rerun;
   int maxIter = 500;
   do {
+    if (isCancelled()) {
+      return;
+    }
     rerun = false;
     relattice();
     // Check for lines that cross other rooms
@@ -592,16 +1299,16 @@ void MapLayout::relax()
       if (pp.isEmpty()) {
         continue;
       }
-      const MapRoom* moveRoom = map->room(moveRoomId);
+      const MapRoom* moveRoom = findRoom(moveRoomId);
       // moveRoomId lies on the path between the rooms in pp
       for (int fromId : pp) {
-        const MapRoom* fromRoom = map->room(fromId);
+        const MapRoom* fromRoom = findRoom(fromId);
         for (const MapExit& exit : fromRoom->exits) {
           if (exit.dest == fromId || !pp.contains(exit.dest)) {
             continue;
           }
           if (exit.dest < fromId) {
-            const MapRoom* toRoom = map->room(exit.dest);
+            const MapRoom* toRoom = findRoom(exit.dest);
             if (toRoom->hasExitTo(fromId)) {
               // Already checked this connection
               continue;
@@ -661,53 +1368,208 @@ void MapLayout::relax()
       }
     }
   } while (rerun && --maxIter > 0);
-  maxIter = 500;
-  do {
-    rerun = false;
-    for (auto [ roomId, startPoint ] : pairs(coords)) {
-      double initial = tension(roomId);
-      if (!initial) {
+  for (int round = 0; round < 10 && relaxTension(); round++) {
+    relattice();
+  }
+  boundingBox = boundingRect(coords);
+}
+
+bool MapLayout::Builder::relaxTension()
+{
+  // Flatten the layer so that evaluating a move is plain arithmetic
+  struct Edge {
+    int dest;
+    ExitVector vector;
+    double weight;
+  };
+  struct PathEdge {
+    int from;
+    int to;
+    QPointF dir;
+  };
+
+  QList<int> roomIds = coords.keys();
+  int count = roomIds.size();
+  QHash<int, int> slots;
+  slots.reserve(count);
+  QVector<QPointF> pos(count);
+  for (int i = 0; i < count; i++) {
+    slots[roomIds[i]] = i;
+    pos[i] = coords[roomIds[i]];
+  }
+
+  QVector<Edge> edges;
+  QVector<int> edgeStart(count + 1);
+  QVector<PathEdge> paths;
+  QVector<QVector<int>> roomPaths(count);
+  QVector<QVector<int>> dependents(count);
+  for (int i = 0; i < count; i++) {
+    edgeStart[i] = edges.size();
+    const MapRoom* room = findRoom(roomIds[i]);
+    for (auto [ dir, exit ] : cpairs(room->exits)) {
+      int dest = slots.value(exit.dest, -1);
+      if (dest < 0) {
         continue;
       }
-      QMap<int, QPointF> substitutions;
-      static const QPointF offsetSteps[] = {
-        { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 },
-        { -2, 0 }, { 2, 0 }, { 0, -2 }, { 0, 2 },
-        { 1, 1 }, { -1, -1 },
-      };
-      QPointF bestPoint = startPoint;
-      double bestTension = initial;
-      for (const QPointF& offset : offsetSteps) {
-        QPointF pt = startPoint + offset;
-        auto pair = pointToPair(pt);
-        if (coordsRev.contains(pair)) {
-          continue;
-        }
-        auto pp = pathPoints.value(pair);
-        if (pp.size() == 2 ? !pp.contains(roomId) : pp.size() > 2) {
-          continue;
-        }
-        substitutions[roomId] = pt;
-        double t = tension(roomId, substitutions);
-        if (t == bestTension && (offset.x() < 0 || offset.y() < 0)) {
-          bestTension = t;
-          bestPoint = pt;
-        } else if (t < bestTension || (t == bestTension && (offset.x() < 0 || offset.y() < 0))) {
-          bestTension = t;
-          bestPoint = pt;
-        }
+      edges << (Edge){ dest, exitVector(room->id, findRoom(exit.dest), dir), 1 };
+      dependents[dest] << i;
+      roomPaths[i] << paths.size();
+      if (dest != i) {
+        roomPaths[dest] << paths.size();
       }
-      if (bestTension < initial || (bestTension == initial && bestPoint != startPoint)) {
-        coordsRev.remove(pointToPair(startPoint));
-        coords[roomId] = bestPoint;
-        coordsRev[pointToPair(bestPoint)] = roomId;
-        rerun = true;
-        break;
+      paths << (PathEdge){ i, dest, dirVectors[dir] };
+    }
+    for (int sourceRoomId : oneWayExits.value(room->id)) {
+      int source = slots.value(sourceRoomId, -1);
+      if (source < 0) {
+        continue;
       }
+      const MapRoom* sourceRoom = findRoom(sourceRoomId);
+      QString dir = MapRoom::reverseDir(sourceRoom->findExit(room->id));
+      edges << (Edge){ source, exitVector(room->id, sourceRoom, dir), 0.5 };
+      dependents[source] << i;
     }
-    relattice();
-  } while (rerun && --maxIter > 0);
-  calculateBoundingBox();
+  }
+  edgeStart[count] = edges.size();
+
+  auto roomTension = [&](int index, const QPointF& point) {
+    double total = 0;
+    for (int e = edgeStart[index]; e < edgeStart[index + 1]; e++) {
+      const Edge& edge = edges[e];
+      int t = exitTension(point, edge.dest == index ? point : pos[edge.dest], edge.vector, false);
+      if (t > 0) {
+        total += t * edge.weight;
+      }
+    }
+    return total;
+  };
+
+  // Lattice points crossed by straight exit lines, with how many lines put each room there
+  QHash<QPair<int, int>, QHash<int, int>> pathCounts;
+  auto markPoint = [&](const QPair<int, int>& point, const PathEdge& path, int delta) {
+    QHash<int, int>& rooms = pathCounts[point];
+    for (int room : { path.from, path.to }) {
+      int& marks = rooms[room];
+      marks += delta;
+      if (marks <= 0) {
+        rooms.remove(room);
+      }
+    }
+    if (rooms.isEmpty()) {
+      pathCounts.remove(point);
+    }
+  };
+  auto markPath = [&](const PathEdge& path, int delta) {
+    QPointF startPoint = pos[path.from];
+    QPointF endPoint = pos[path.to];
+    int dx = endPoint.x() - startPoint.x();
+    int dy = endPoint.y() - startPoint.y();
+    if ((dx < 0) != (path.dir.x() < 0) || (dy < 0) != (path.dir.y() < 0)) {
+      return;
+    }
+    QPair<int, int> pp(startPoint.x() * 1024, startPoint.y() * 1024);
+    if (dy == 0 && (dx < -1 || dx > 1)) {
+      auto [minX, maxX] = in_order<int>(startPoint.x(), endPoint.x());
+      for (int x = minX + 1; x <= maxX - 1; x++) {
+        pp.first = x * 1024;
+        markPoint(pp, path, delta);
+      }
+    } else if (dx == 0 && (dy < -1 || dy > 1)) {
+      auto [minY, maxY] = in_order<int>(startPoint.y(), endPoint.y());
+      for (int y = minY + 1; y <= maxY - 1; y++) {
+        pp.second = y * 1024;
+        markPoint(pp, path, delta);
+      }
+    } else if (qAbs(dx) > 1 && (dx == dy || dx == -dy)) {
+      QPoint step(signum(dx), signum(dy));
+      QPoint i = (startPoint + step).toPoint();
+      for (int n = 1; n < qAbs(dx); n++, i += step) {
+        markPoint(pointToPair(i), path, delta);
+      }
+    }
+  };
+
+  QHash<QPair<int, int>, int> occupied;
+  occupied.reserve(count);
+  for (int i = 0; i < count; i++) {
+    occupied[pointToPair(pos[i])] = i;
+  }
+  for (const PathEdge& path : paths) {
+    markPath(path, 1);
+  }
+
+  static const QPointF offsetSteps[] = {
+    { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 },
+    { -2, 0 }, { 2, 0 }, { 0, -2 }, { 0, 2 },
+    { 1, 1 }, { -1, -1 },
+  };
+
+  // Rooms are revisited only when one of their neighbours has moved
+  QVector<int> queue;
+  QVector<bool> queued(count, true);
+  for (int i = 0; i < count; i++) {
+    queue << i;
+  }
+  int moves = 0;
+  int maxMoves = 500 + count * 10;
+  for (int head = 0; head < queue.size() && moves < maxMoves; head++) {
+    if (isCancelled()) {
+      return false;
+    }
+    int index = queue[head];
+    queued[index] = false;
+    QPointF startPoint = pos[index];
+    double initial = roomTension(index, startPoint);
+    if (!initial) {
+      continue;
+    }
+    QPointF bestPoint = startPoint;
+    double bestTension = initial;
+    for (const QPointF& offset : offsetSteps) {
+      QPointF pt = startPoint + offset;
+      auto pair = pointToPair(pt);
+      if (occupied.contains(pair)) {
+        continue;
+      }
+      auto pp = pathCounts.constFind(pair);
+      int pathRooms = pp == pathCounts.constEnd() ? 0 : pp->size();
+      if (pathRooms == 2 ? !pp->contains(index) : pathRooms > 2) {
+        continue;
+      }
+      double t = roomTension(index, pt);
+      if (t < bestTension || (t == bestTension && (offset.x() < 0 || offset.y() < 0))) {
+        bestTension = t;
+        bestPoint = pt;
+      }
+    }
+    if (bestTension < initial || (bestTension == initial && bestPoint != startPoint)) {
+      for (int path : roomPaths[index]) {
+        markPath(paths[path], -1);
+      }
+      occupied.remove(pointToPair(startPoint));
+      pos[index] = bestPoint;
+      occupied[pointToPair(bestPoint)] = index;
+      for (int path : roomPaths[index]) {
+        markPath(paths[path], 1);
+      }
+      ++moves;
+      if (!queued[index]) {
+        queued[index] = true;
+        queue << index;
+      }
+      for (int other : dependents[index]) {
+        if (!queued[other]) {
+          queued[other] = true;
+          queue << other;
+        }
+      }
+    }
+  }
+
+  for (int i = 0; i < count; i++) {
+    coords[roomIds[i]] = pos[i];
+  }
+  return moves > 0;
 }
 
 QSize MapLayout::displaySize() const
@@ -715,10 +1577,56 @@ QSize MapLayout::displaySize() const
   return boundingBox.size().toSize();
 }
 
-void MapLayout::render(QPainter* painter, const QRectF&, bool drawLabels) const
+void MapLayout::paint(QPainter* painter, const QRect& exposed, double zoom, bool drawLabels)
+{
+  Detail detail = zoom < OUTLINE_ZOOM ? OutlineDetail : zoom < LABEL_ZOOM ? RoomDetail : FullDetail;
+  drawLabels = drawLabels && detail == FullDetail;
+  qreal pixelRatio = painter->device()->devicePixelRatioF();
+  int zoomKey = qRound(zoom * 1024);
+
+  int x0 = std::floor(double(exposed.left()) / TILE_SIZE), x1 = std::floor(double(exposed.right()) / TILE_SIZE);
+  int y0 = std::floor(double(exposed.top()) / TILE_SIZE), y1 = std::floor(double(exposed.bottom()) / TILE_SIZE);
+  for (int y = y0; y <= y1; y++) {
+    for (int x = x0; x <= x1; x++) {
+      TileKey key{ zoomKey, qRound(pixelRatio * 100), x, y, drawLabels };
+      QPixmap* tile = tiles.object(key);
+      if (tile) {
+        painter->drawPixmap(x * TILE_SIZE, y * TILE_SIZE, *tile);
+        continue;
+      }
+      tile = new QPixmap(qRound(TILE_SIZE * pixelRatio), qRound(TILE_SIZE * pixelRatio));
+      tile->setDevicePixelRatio(pixelRatio);
+      tile->fill(Qt::transparent);
+      QPainter p(tile);
+      p.translate(-x * TILE_SIZE, -y * TILE_SIZE);
+      p.scale(zoom, zoom);
+      render(&p, QRectF(x * TILE_SIZE / zoom, y * TILE_SIZE / zoom, TILE_SIZE / zoom, TILE_SIZE / zoom), detail, drawLabels);
+      p.end();
+      painter->drawPixmap(x * TILE_SIZE, y * TILE_SIZE, *tile);
+      // The cache takes ownership of the tile
+      tiles.insert(key, tile, tile->width() * tile->height() * 4 / 1024);
+    }
+  }
+}
+
+void MapLayout::render(QPainter* painter, const QRectF& viewport, Detail detail, bool drawLabels) const
 {
   int nl = 0;
 
+  // Work out what's visible in layout coordinates
+  QRectF visible;
+  if (viewport.isValid()) {
+    visible = QRectF((viewport.topLeft() + boundingBox.topLeft()) / COORD_SCALE, viewport.size() / COORD_SCALE);
+  } else {
+    visible = QRectF(boundingBox.topLeft() / COORD_SCALE, boundingBox.size() / COORD_SCALE);
+  }
+  QVector<int> visibleRooms = index.query(visible.adjusted(-1, -1, 1, 1));
+
+  static const QPen exitPen(Qt::black, 0);
+  static const QPen stubPen(Qt::black, 0, Qt::DashLine);
+  static const QPen roomPen(Qt::black, 0.5);
+  static const QFont labelFont("sans-serif", 2.0);
+
   painter->save();
   painter->translate(-boundingBox.x(), -boundingBox.y());
 
@@ -733,15 +1641,23 @@ void MapLayout::render(QPainter* painter, const QRectF&, bool drawLabels) const
     c.setAlpha(128);
     painter->setPen(QPen(c, 0));
     c.setAlpha(8);
+    if (!layer.polygon.boundingRect().translated(-0.5, -0.5).intersects(visible)) {
+      continue;
+    }
     painter->setBrush(c);
     painter->drawPolygon(layer.polygon);
   }
 
   painter->restore();
 
-  painter->setFont(QFont("sans-serif", 2.0));
-  painter->setPen(QPen(Qt::black, 0));
-  for (int roomId : coords.keys()) {
+  if (detail == OutlineDetail) {
+    painter->restore();
+    return;
+  }
+
+  painter->setFont(labelFont);
+  painter->setPen(exitPen);
+  for (int roomId : visibleRooms) {
     QPointF pos = coords[roomId] * COORD_SCALE;
 
     static const QPointF OFFSET(COORD_SCALE, COORD_SCALE);
@@ -749,6 +1665,9 @@ void MapLayout::render(QPainter* painter, const QRectF&, bool drawLabels) const
     QRectF rect(pos - OFFSET, SIZE);
 
     const MapRoom* room = map->room(roomId);
+    if (!room) {
+      continue;
+    }
     for (const QString& dir : room->exits.keys()) {
       int dest = room->exits[dir].dest;
       if (dest == roomId) {
@@ -783,7 +1702,7 @@ void MapLayout::render(QPainter* painter, const QRectF&, bool drawLabels) const
             end -= oneWayOffset.value(revDir) * ROOM_SIZE;
           }
         } else {
-          painter->setPen(QPen(Qt::black, 0));
+          painter->setPen(exitPen);
         }
         if (nonlinear) {
           static QMap<int, QColor> lineColors;
@@ -793,7 +1712,7 @@ void MapLayout::render(QPainter* painter, const QRectF&, bool drawLabels) const
           }
           painter->setPen(QPen(lineColors[nlKey], 0));
         }
-        if (oneWay) {
+        if (oneWay && detail == FullDetail) {
           QPointF slope = -normalized(dirVectors[revDir]);
           QPointF perp = QPointF(-slope.y(), slope.x()) * 0.5;
           QPolygonF arrow({ end, end + perp - slope * 2, end - perp - slope * 2 });
@@ -819,28 +1738,31 @@ void MapLayout::render(QPainter* painter, const QRectF&, bool drawLabels) const
           painter->drawLine(start, end);
         }
       } else {
-        painter->setPen(QPen(Qt::black, 0, Qt::DashLine));
+        painter->setPen(stubPen);
         QPointF endpoint = pos + dirVectors[dir] * STEP_SIZE;
         painter->drawLine(pos, endpoint);
-        if (other && other->zone != title && !other->zone.isEmpty() && other->zone != "-") {
+        if (detail == FullDetail && other && other->zone != title && !other->zone.isEmpty() && other->zone != "-") {
           painter->setBrush(Qt::white);
           painter->drawEllipse(QRectF(endpoint - QPoint(1.5, 1.5), endpoint + QPoint(1.5, 1.5)));
         }
-        painter->setPen(QPen(Qt::black, 0));
+        painter->setPen(exitPen);
       }
     }
   }
 
-  painter->setPen(QPen(Qt::black, 0.5));
-  for (int roomId : coords.keys()) {
+  painter->setPen(roomPen);
+  for (int roomId : visibleRooms) {
     QPointF pos = coords[roomId] * COORD_SCALE;
     QRectF rect(pos - ROOM_OFFSET, ROOM_SIZEF);
-    QColor color = map->roomColor(roomId);
-    painter->setBrush(color.isValid() ? color : Qt::white);
+    auto style = styles.constFind(roomId);
+    if (style == styles.constEnd()) {
+      continue;
+    }
+    painter->setBrush(style->fill);
     painter->drawRect(rect.toRect());
     painter->setBrush(Qt::black);
     if (drawLabels) {
-      painter->drawText(rect.toRect().adjusted(0, 0, 0, -1), Qt::AlignCenter, QString::number(roomId % 100));
+      painter->drawText(rect.toRect().adjusted(0, 0, 0, -1), Qt::AlignCenter, style->label);
     }
   }
 
@@ -849,7 +1771,16 @@ void MapLayout::render(QPainter* painter, const QRectF&, bool drawLabels) const
 
 const MapRoom* MapLayout::roomAt(const QPointF& _pt) const
 {
-  QPointF pt = (_pt + boundingBox.topLeft()) / COORD_SCALE;
+  QPointF layoutPt = _pt + boundingBox.topLeft();
+  for (int roomId : index.query(QRectF(layoutPt / COORD_SCALE, QSizeF()))) {
+    QRectF rect(coords[roomId] * COORD_SCALE - ROOM_OFFSET, ROOM_SIZEF);
+    if (rect.contains(layoutPt)) {
+      return map->room(roomId);
+    }
+  }
+
+  // Zone exit markers are only tracked on the lattice
+  QPointF pt = layoutPt / COORD_SCALE;
   // Round to nearest quarter-point, bias away from zero
   pt.setX(int(pt.x() * 4 + 0.5 * signum(pt.x())) / 4.0);
   pt.setY(int(pt.y() * 4 + 0.5 * signum(pt.y())) / 4.0);
@@ -871,12 +1802,18 @@ QRectF MapLayout::roomPos(int roomId) const
   return rect;
 }
 
-void MapLayout::calculateRegion(LayerData& layer)
+QVector<int> MapLayout::roomsIn(const QRectF& rect) const
+{
+  QRectF layoutRect = rect.translated(boundingBox.topLeft());
+  return index.query(QRectF(layoutRect.topLeft() / COORD_SCALE, layoutRect.size() / COORD_SCALE).adjusted(-1, -1, 1, 1));
+}
+
+void MapLayout::Builder::calculateRegion(LayerData& layer)
 {
   QRegion r;
   for (auto [ roomId, pos ] : cpairs(layer.coords)) {
     bool hasExit = false;
-    for (const auto& [ dir, exit ] : cpairs(map->room(roomId)->exits)) {
+    for (const auto& [ dir, exit ] : cpairs(findRoom(roomId)->exits)) {
       if (!layer.coords.contains(exit.dest)) {
         continue;
       }
@@ -943,7 +1880,7 @@ void MapLayout::calculateRegion(LayerData& layer)
   layer.boundingBox = layer.region.boundingRect();
 }
 
-MapLayout::LayerData* MapLayout::findLayer(int roomId)
+MapLayout::LayerData* MapLayout::Builder::findLayer(int roomId)
 {
   for (LayerData& layer : layers) {
     if (layer.coords.contains(roomId)) {
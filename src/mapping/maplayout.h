@@ -9,6 +9,11 @@
 #include <QRegion>
 #include <QColor>
 #include <QPointer>
+#include <QPixmap>
+#include <QCache>
+#include <QObject>
+#include <QFuture>
+#include <atomic>
 #include <memory>
 #include "mapsearch.h"
 class QPainter;
@@ -16,25 +21,44 @@ class MapManager;
 class MapZone;
 class MapRoom;
 
-class MapLayout
+class MapLayout : public QObject
 {
+Q_OBJECT
 public:
   using Clique = MapSearch::Clique;
 
-  MapLayout(MapManager* map);
+  MapLayout(MapManager* map, QObject* parent = nullptr);
+  ~MapLayout();
 
+  // Shows a rough placement immediately and refines it in the background
   void loadZone(const MapZone* zone, bool force = false);
   QString currentZone;
 
+  // Places a new room next to its neighbours without a full relayout
+  void roomChanged(int roomId);
+  // Recomputes room colors after the room type settings change
+  void invalidateStyles();
+
   QSize displaySize() const;
-  void render(QPainter* painter, const QRectF& viewport, bool drawLabels = true) const;
+  // Paints the exposed part of the map from cached tiles at the given zoom level
+  void paint(QPainter* painter, const QRect& exposed, double zoom, bool drawLabels = true);
 
   const MapRoom* roomAt(const QPointF& pt) const;
   QRectF roomPos(int roomId) const;
+  // Rooms that may overlap the given rectangle, in display units
+  QVector<int> roomsIn(const QRectF& rect) const;
+
+signals:
+  void layoutUpdated();
+
+private slots:
+  void searchUpdated();
 
 private:
+  class Builder;
+
   struct LayerData {
-    Clique::Ref source;
+    int source;
     QMap<int, QPointF> coords;
     QRectF boundingBox;
     int zIndex;
@@ -43,30 +67,82 @@ private:
     QSet<QPair<int, int>> layerExits;
   };
 
-  void loadClique(Clique::RefR clique, int roomId, int zIndex);
-  void relattice();
-  void markPathPoints();
-  void relax();
-  void calculateBoundingBox();
-  void calculateRegion(LayerData& layer);
+  struct Result {
+    QString title;
+    QRectF boundingBox;
+    QMap<int, QPointF> coords;
+    QHash<QPair<int, int>, int> coordsRev;
+    QList<LayerData> layers;
+  };
+
+  // Uniform grid over layout coordinates. Each room is filed under every
+  // cell touched by its rectangle or its exit lines.
+  struct SpatialIndex {
+    QHash<QPair<int, int>, QVector<int>> cells;
 
-  double tension(int roomId, int destRoomId, const QString& dir, const QMap<int, QPointF>& substitutions = {}, bool weightHigh = false) const;
-  double tension(int roomId, const QMap<int, QPointF>& substitutions = {}, bool weightHigh = false) const;
-  double tension(const QMap<int, QPointF>& substitutions = {}) const;
+    void insert(int roomId, const QRectF& bounds);
+    QVector<int> query(const QRectF& bounds) const;
+  };
 
-  LayerData* findLayer(int roomId);
+  struct RoomStyle {
+    QColor fill;
+    QString label;
+  };
+
+  enum Detail {
+    OutlineDetail,
+    RoomDetail,
+    FullDetail,
+  };
+
+  struct TileKey {
+    int zoom;
+    int pixelRatio;
+    int x;
+    int y;
+    bool labels;
+
+    inline bool operator==(const TileKey& other) const {
+      return zoom == other.zoom && pixelRatio == other.pixelRatio && x == other.x && y == other.y && labels == other.labels;
+    }
+  };
+  friend inline uint qHash(const TileKey& key, uint seed = 0) {
+    return qHash(qMakePair(qMakePair(key.zoom, key.pixelRatio), qMakePair(key.x, key.y)), seed) ^ uint(key.labels);
+  }
+
+  void render(QPainter* painter, const QRectF& viewport, Detail detail, bool drawLabels) const;
+  void invalidateTiles(int roomId);
+
+  void cancel();
+  void applyResult(quint64 gen, const Result& result);
+  void indexRoom(int roomId);
+  void updateStyle(int roomId);
+  bool placeRoom(const MapRoom* room);
+  bool isOnPath(const QPointF& pt) const;
+
+  // Finished layouts are saved next to the map file, keyed by a hash of the zone's contents
+  QString cacheFile(const QString& zone) const;
+  static bool readCache(const QString& path, const QString& zone, QByteArray* hash, Result* result);
+  static void writeCache(const QString& path, const QString& zone, const QByteArray& hash, const Result& result);
 
   QString title;
   QRectF boundingBox;
   QMap<int, QPointF> coords;
-  QMap<int, int> roomLayers;
   QHash<QPair<int, int>, int> coordsRev;
-  QMap<QPair<int, int>, QSet<int>> pathPoints;
-  QMap<int, QSet<int>> oneWayExits;
   QList<LayerData> layers;
-  QMap<int, int> pendingLayers;
+  SpatialIndex index;
+  QHash<int, RoomStyle> styles;
+  QCache<TileKey, QPixmap> tiles;
   MapManager* map;
-  MapSearch* search;
+  std::shared_ptr<MapSearch> search;
+
+  // Cancelled builders keep running until they notice, and they all post back to this object
+  QList<QFuture<void>> jobs;
+  std::shared_ptr<std::atomic<bool>> cancelled;
+  quint64 generation;
+  // Set when the displayed layout no longer matches the zone
+  bool stale;
+  int conflicts;
 };
 
 #endif
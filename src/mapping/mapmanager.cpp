@@ -7,7 +7,11 @@
 #include <QSettings>
 #include <QDir>
 #include <QStandardPaths>
+#include <QTimer>
+#include <QtConcurrent>
 #include <time.h>
+#include <utility>
+#include <algorithm>
 #include <QtDebug>
 
 QString MapManager::mapForProfile(const QString& profile)
@@ -51,9 +55,19 @@ QColor MapManager::colorHeuristic(const QString& roomType)
 }
 
 MapManager::MapManager(QObject* parent)
-: QObject(parent), mapFile(nullptr), gmcpMode(false), autoRoomId(1), mapSearch(nullptr)
+: QObject(parent), mapFile(nullptr), gmcpMode(false), autoRoomId(1),
+  searchWatcher(new QFutureWatcher<bool>(this)), searchTimer(new QTimer(this)), searchPending(false)
 {
-  // initializers only
+  searchTimer->setSingleShot(true);
+  searchTimer->setInterval(0);
+  QObject::connect(searchTimer, SIGNAL(timeout()), this, SLOT(startSearchUpdate()));
+  QObject::connect(searchWatcher, SIGNAL(finished()), this, SLOT(searchUpdateFinished()));
+}
+
+MapManager::~MapManager()
+{
+  // The worker may still be using the working search
+  searchWatcher->waitForFinished();
 }
 
 void MapManager::loadProfile(const QString& profile)
@@ -73,10 +87,26 @@ void MapManager::loadMap(const QString& mapFileName)
   }
   mapFile = new QSettings(mapFileName, QSettings::IniFormat, this);
   emit reset();
+  // Anything the worker is still doing belongs to the old map
+  searchWatcher->waitForFinished();
+  searchWatcher->setFuture(QFuture<bool>());
   mapSearch.reset();
+  workingSearch.reset();
+  pendingRoomIds.clear();
+  pendingZones.clear();
   rooms.clear();
+  roomIndex.clear();
   autoRoomId = mapFile->value("autoID", 1).toInt();
 
+  {
+    // Read once here; searchChanges() needs the list on every update
+    SettingsGroup sg(mapFile, " Routing/avoidRooms");
+    avoidRoomIds.clear();
+    for (const QString& key : mapFile->childKeys()) {
+      avoidRoomIds << mapFile->value(key).toInt();
+    }
+  }
+
   {
     SettingsGroup sg(mapFile, " RoomTypes");
     roomCosts.clear();
@@ -145,6 +175,14 @@ void MapManager::loadMap(const QString& mapFileName)
   }
 
   gmcpMode = zones.size() > 1;
+
+  // Start building routing data right away. Until it's done, search() returns null.
+  workingSearch.reset(new MapSearch(this));
+  for (int roomId : keys(rooms)) {
+    pendingRoomIds << roomId;
+  }
+  searchPending = true;
+  startSearchUpdate();
 }
 
 void MapManager::updateRoom(const QVariantMap& info)
@@ -156,6 +194,7 @@ void MapManager::updateRoom(const QVariantMap& info)
   MapRoom& room = rooms[roomId];
   room.id = roomId;
   room.name = info["name"].toString();
+  newRoom = newRoom || room.zone != zoneName || room.roomType != info["type"].toString();
   room.zone = zoneName;
   room.roomType = info["type"].toString();
   if (!room.roomType.isEmpty()) {
@@ -173,6 +212,7 @@ void MapManager::updateRoom(const QVariantMap& info)
     MapExit& exit = room.exits[dir];
     QVariantMap exitInfo = exits[dir].toMap();
     QString status = exitInfo["door"].toString().toUpper();
+    newRoom = newRoom || exit.dest != exitInfo["to_room"].toInt();
     exit.dest = exitInfo["to_room"].toInt();
     exit.door = exitInfo["is_door"].toBool();
     exit.locked = exit.door && status == "LOCKED";
@@ -186,17 +226,134 @@ void MapManager::updateRoom(const QVariantMap& info)
 
   MapZone* zone = mutableZone(zoneName);
   zone->addRoom(&room);
+  reindexRoom(&room);
 
   if (mapFile) {
     saveRoom(&room);
   }
-  if (newRoom && mapSearch) {
-    mapSearch->markDirty(zone);
+  if (newRoom) {
+    invalidateRoom(roomId);
   }
 
   emit roomUpdated(roomId);
 }
 
+void MapManager::reindexRoom(const MapRoom* room)
+{
+  roomIndex.updateRoom(room);
+}
+
+void MapManager::removeRoom(int roomId)
+{
+  auto iter = rooms.find(roomId);
+  if (iter == rooms.end()) {
+    return;
+  }
+  if (mapFile) {
+    mapFile->remove(QStringLiteral("%1/%2").arg(iter->zone.isEmpty() ? "-" : iter->zone).arg(roomId));
+  }
+  for (auto& zone : zones) {
+    zone.second.roomIds.remove(roomId);
+  }
+  rooms.erase(iter);
+  roomIndex.removeRoom(roomId);
+  invalidateRoom(roomId);
+
+  emit roomUpdated(roomId);
+}
+
+QList<int> MapManager::matchingRooms(const QString& name, const QString& description, const QStringList& exits) const
+{
+  if (!roomIndex.isBuilt()) {
+    roomIndex.rebuild(rooms);
+  }
+  return roomIndex.matchingRooms(name, description, exits);
+}
+
+void MapManager::invalidateRoom(int roomId)
+{
+  pendingRoomIds << roomId;
+  queueSearchUpdate();
+  if (mapLayout) {
+    mapLayout->roomChanged(roomId);
+  }
+}
+
+void MapManager::queueSearchUpdate()
+{
+  searchPending = true;
+  if (!searchWatcher->isRunning()) {
+    // Coalesce changes made in the same event loop iteration
+    searchTimer->start();
+  }
+}
+
+MapSearch::MapChanges MapManager::searchChanges(const QSet<int>& roomIds) const
+{
+  // Only the rooms that changed are copied. The copies share their strings
+  // and exits with the live rooms, but not the room table itself.
+  MapSearch::MapChanges changes;
+  for (int roomId : roomIds) {
+    auto iter = rooms.constFind(roomId);
+    if (iter == rooms.constEnd()) {
+      changes.removedRoomIds << roomId;
+      continue;
+    }
+    changes.rooms[roomId] = *iter;
+    const MapZone* zone = this->zone(iter->zone);
+    if (zone && zone->roomIds.contains(roomId)) {
+      changes.zoneRoomIds << roomId;
+    }
+  }
+  for (const auto& iter : zones) {
+    changes.zones[iter.first] = MapSearch::ZoneInfo{ iter.second.name, iter.second.index };
+  }
+  changes.roomCosts = roomCosts;
+  changes.avoidRooms = avoidRoomIds;
+  changes.gmcpMode = gmcpMode;
+  return changes;
+}
+
+void MapManager::startSearchUpdate()
+{
+  if (!searchPending || !workingSearch || searchWatcher->isRunning()) {
+    return;
+  }
+  searchPending = false;
+
+  // The worker only sees copies of the rooms that changed since the last update
+  MapSearch* working = workingSearch.get();
+  MapSearch::MapChanges changes = searchChanges(std::exchange(pendingRoomIds, {}));
+  QSet<const MapZone*> dirtyZones = std::exchange(pendingZones, {});
+  searchWatcher->setFuture(QtConcurrent::run([working, changes, dirtyZones]{
+    working->applyChanges(changes);
+    for (const MapZone* zone : dirtyZones) {
+      working->markDirty(zone);
+    }
+    return working->precompute();
+  }));
+}
+
+void MapManager::searchUpdateFinished()
+{
+  QFuture<bool> future = searchWatcher->future();
+  if (!future.isFinished() || future.resultCount() == 0) {
+    return;
+  }
+  bool changed = future.result();
+  // Forget the result so it can't be adopted twice
+  searchWatcher->setFuture(QFuture<bool>());
+  if (changed || !mapSearch) {
+    // The worker is idle now. Taking the snapshot here keeps it on the GUI
+    // thread, and it only shares the working search's data.
+    mapSearch.reset(workingSearch->snapshot());
+    emit searchUpdated();
+  }
+  if (searchPending) {
+    searchTimer->start();
+  }
+}
+
 const MapRoom* MapManager::room(int id) const
 {
   auto iter = rooms.find(id);
@@ -218,37 +375,74 @@ QList<const MapRoom*> MapManager::searchForRooms(const QStringList& args, bool n
   if (args.isEmpty()) {
     return {};
   }
-  QList<const MapRoom*> filtered;
-  QRegularExpression re(args.first(), QRegularExpression::CaseInsensitiveOption);
-  QString matchZone;
+  const MapZone* zoneObj = nullptr;
   if (!zone.isEmpty()) {
-    const MapZone* zoneObj = searchForZone(zone);
+    zoneObj = searchForZone(zone);
     if (!zoneObj) {
       return {};
     }
-    matchZone = zoneObj->name;
   }
-  for (const MapRoom& room : rooms) {
-    if (!matchZone.isEmpty() && room.zone != matchZone) {
+  QList<QRegularExpression> patterns;
+  for (const QString& arg : args) {
+    patterns << QRegularExpression(arg, QRegularExpression::CaseInsensitiveOption);
+  }
+
+  if (!roomIndex.isBuilt()) {
+    roomIndex.rebuild(rooms);
+  }
+  QVector<int> candidates;
+  if (!roomIndex.candidates(args, namesOnly, &candidates)) {
+    // Nothing to look up, so check every room in scope
+    if (zoneObj) {
+      for (int roomId : zoneObj->roomIds) {
+        candidates << roomId;
+      }
+      std::sort(candidates.begin(), candidates.end());
+    } else {
+      candidates = rooms.keys().toVector();
+    }
+  }
+
+  QList<const MapRoom*> filtered;
+  for (int roomId : candidates) {
+    if (zoneObj && !zoneObj->roomIds.contains(roomId)) {
       continue;
     }
-    if (re.match(room.name).hasMatch()) {
-      filtered << &room;
-    } else if (!namesOnly && re.match(room.description).hasMatch()) {
-      filtered << &room;
+    auto iter = rooms.constFind(roomId);
+    if (iter == rooms.constEnd()) {
+      continue;
     }
-  }
-  for (const QString& arg : args.mid(1)) {
-    re.setPattern(arg);
-    QList<const MapRoom*> nextRound;
-    for (const MapRoom* room : filtered) {
-      if (re.match(room->name).hasMatch()) {
-        nextRound << room;
-      } else if (!namesOnly && re.match(room->description).hasMatch()) {
-        nextRound << room;
+    bool matched = true;
+    for (const QRegularExpression& re : patterns) {
+      if (!re.match(iter->name).hasMatch() && (namesOnly || !re.match(iter->description).hasMatch())) {
+        matched = false;
+        break;
       }
     }
-    filtered = nextRound;
+    if (matched) {
+      filtered << &*iter;
+    }
+  }
+  return filtered;
+}
+
+QList<const MapRoom*> MapManager::searchForRoomType(const QString& pattern) const
+{
+  QRegularExpression re(pattern, QRegularExpression::CaseInsensitiveOption);
+  QSet<QString> matchTypes;
+  for (const QString& roomType : roomCosts.keys()) {
+    if (re.match(roomType).hasMatch()) {
+      matchTypes << roomType;
+    }
+  }
+  QList<const MapRoom*> filtered;
+  if (matchTypes.isEmpty()) {
+    return filtered;
+  }
+  for (const MapRoom& room : rooms) {
+    if (matchTypes.contains(room.roomType)) {
+      filtered << &room;
+    }
   }
   return filtered;
 }
@@ -282,7 +476,7 @@ MapZone* MapManager::mutableZone(const QString& name)
   if (iter != zones.end()) {
     return &iter->second;
   }
-  auto [newIter, ok] = zones.try_emplace(key, this, key);
+  auto [newIter, ok] = zones.try_emplace(key, this, key, int(zones.size()));
   return &newIter->second;
 }
 
@@ -314,6 +508,11 @@ const MapZone* MapManager::searchForZone(const QString& name) const
 
 void MapManager::saveRoom(MapRoom* room)
 {
+  reindexRoom(room);
+  // The search keeps its own copy of each room, so anything saved has to be sent to it
+  pendingRoomIds << room->id;
+  queueSearchUpdate();
+
   if (!mapFile) {
     qWarning("Cannot save room when no map file is loaded");
     return;
@@ -357,15 +556,16 @@ void MapManager::saveRoom(MapRoom* room)
 }
 
 
-MapSearch* MapManager::search()
+std::shared_ptr<MapSearch> MapManager::search()
 {
-  MapSearch* s = mapSearch.get();
-  if (!s) {
-    s = new MapSearch(this);
-    s->precompute();
-    mapSearch.reset(s);
+  if (!workingSearch) {
+    workingSearch.reset(new MapSearch(this));
+    searchPending = true;
+    startSearchUpdate();
   }
-  return s;
+  // Never wait for the worker here. Callers treat a null search as
+  // "still building" and searchUpdated() is emitted once it's ready.
+  return mapSearch;
 }
 
 MapLayout* MapManager::layout()
@@ -378,6 +578,16 @@ MapLayout* MapManager::layout()
   return l;
 }
 
+WorldLayout* MapManager::worldLayout()
+{
+  WorldLayout* w = mapWorld.get();
+  if (!w) {
+    w = new WorldLayout(this);
+    mapWorld.reset(w);
+  }
+  return w;
+}
+
 int MapManager::waypoint(const QString& name, QString* canonicalName) const
 {
   if (!mapFile) {
@@ -451,21 +661,37 @@ void MapManager::setRoomCost(const QString& roomType, int cost)
   if (mapFile) {
     mapFile->setValue(QStringLiteral(" RoomTypes/%1/cost").arg(roomType), cost);
   }
+  // Stored clique routes depend on room costs
+  pendingZones << nullptr;
+  queueSearchUpdate();
+  emit routingChanged();
 }
 
 QColor MapManager::roomColor(int roomId) const
 {
-  MapRoom room = rooms.value(roomId);
-  QColor color = roomColors.value(room.roomType);
-  if (!color.isValid() && !room.roomType.isEmpty()) {
-    color = colorHeuristic(room.roomType);
+  const MapRoom* room = this->room(roomId);
+  if (!room) {
+    return QColor();
+  }
+  QColor color = roomColors.value(room->roomType);
+  if (!color.isValid() && !room->roomType.isEmpty()) {
+    color = cachedHeuristic(room->roomType);
   }
   if (!color.isValid()) {
-    color = colorHeuristic(room.name);
+    color = cachedHeuristic(room->name);
   }
   return color;
 }
 
+QColor MapManager::cachedHeuristic(const QString& text) const
+{
+  auto iter = heuristicColors.constFind(text);
+  if (iter == heuristicColors.constEnd()) {
+    iter = heuristicColors.insert(text, colorHeuristic(text));
+  }
+  return *iter;
+}
+
 QColor MapManager::roomColor(const QString& roomType) const
 {
   if (roomColors.contains(roomType)) {
@@ -483,6 +709,9 @@ QColor MapManager::roomColor(const QString& roomType) const
 void MapManager::setRoomColor(const QString& roomType, const QColor& color)
 {
   roomColors[roomType] = color;
+  if (mapLayout) {
+    mapLayout->invalidateStyles();
+  }
   if (mapFile) {
     QString key = QStringLiteral(" RoomTypes/%1/color").arg(roomType);
     if (color.isValid()) {
@@ -508,6 +737,12 @@ void MapManager::removeRoomType(const QString& roomType)
 {
   roomCosts.remove(roomType);
   roomColors.remove(roomType);
+  pendingZones << nullptr;
+  queueSearchUpdate();
+  emit routingChanged();
+  if (mapLayout) {
+    mapLayout->invalidateStyles();
+  }
 
   if (mapFile) {
     mapFile->remove(QStringLiteral(" RoomTypes/%1").arg(roomType));
@@ -534,11 +769,41 @@ void MapManager::setRouteAvoidZones(const QStringList& zones)
     qWarning() << "No map file to save to";
     return;
   }
-  mapFile->remove(" Routing/avoid");
-  SettingsGroup sg(mapFile, " Routing/avoid");
-  for (auto [index, zone] : enumerate(zones)) {
-    mapFile->setValue(QString::number(index), zone);
+  {
+    mapFile->remove(" Routing/avoid");
+    SettingsGroup sg(mapFile, " Routing/avoid");
+    for (auto [index, zone] : enumerate(zones)) {
+      mapFile->setValue(QString::number(index), zone);
+    }
+  }
+  emit routingChanged();
+}
+
+QList<int> MapManager::routeAvoidRooms() const
+{
+  return avoidRoomIds;
+}
+
+void MapManager::setRouteAvoidRooms(const QList<int>& roomIds)
+{
+  if (!mapFile) {
+    qWarning() << "No map file to save to";
+    return;
+  }
+  {
+    mapFile->remove(" Routing/avoidRooms");
+    SettingsGroup sg(mapFile, " Routing/avoidRooms");
+    for (auto [index, roomId] : enumerate(roomIds)) {
+      mapFile->setValue(QString::number(index), roomId);
+    }
+  }
+  // Touch the rooms on both lists so the search publishes a snapshot with the new list
+  for (int roomId : avoidRoomIds + roomIds) {
+    pendingRoomIds << roomId;
   }
+  avoidRoomIds = roomIds;
+  queueSearchUpdate();
+  emit routingChanged();
 }
 
 class MapDownloader : public QObject
@@ -6,12 +6,16 @@
 #include <QSet>
 #include <QRegularExpression>
 #include <QColor>
+#include <QFutureWatcher>
 #include <memory>
 #include <map>
 #include "mapzone.h"
 #include "mapsearch.h"
 #include "maplayout.h"
+#include "worldlayout.h"
+#include "roomindex.h"
 class QSettings;
+class QTimer;
 
 class MapManager : public QObject
 {
@@ -21,10 +25,12 @@ public:
   static QColor colorHeuristic(const QString& roomType);
 
   MapManager(QObject* parent = nullptr);
+  ~MapManager();
 
   const MapRoom* room(int id) const;
   MapRoom* mutableRoom(int id);
   QList<const MapRoom*> searchForRooms(const QStringList& args, bool namesOnly, const QString& zone = QString()) const;
+  QList<const MapRoom*> searchForRoomType(const QString& pattern) const;
   void saveRoom(MapRoom* room);
 
   QStringList zoneNames() const;
@@ -32,8 +38,9 @@ public:
   MapZone* mutableZone(const QString& name);
   const MapZone* searchForZone(const QString& name) const;
 
-  MapSearch* search();
+  std::shared_ptr<MapSearch> search();
   MapLayout* layout();
+  WorldLayout* worldLayout();
 
   int waypoint(const QString& name, QString* canonicalName = nullptr) const;
   QStringList waypoints() const;
@@ -57,34 +64,65 @@ public:
 
   QStringList routeAvoidZones() const;
   void setRouteAvoidZones(const QStringList& zones);
+  QList<int> routeAvoidRooms() const;
+  void setRouteAvoidRooms(const QList<int>& roomIds);
 
   QSettings* mapProfile() const;
 
 signals:
   void roomUpdated(int roomId);
   void reset();
+  // A new routing snapshot was published, including the first one after loading a map
+  void searchUpdated();
+  // Room costs or avoided rooms or zones changed
+  void routingChanged();
 
 public slots:
   void loadProfile(const QString& profile);
   void loadMap(const QString& filename);
 
+private slots:
+  void startSearchUpdate();
+  void searchUpdateFinished();
+
 private:
   friend class AutoMapper;
   friend class MapZone;
   friend class MapSearch;
   void downloadMap(const QString& url);
   void updateRoom(const QVariantMap& info);
+  void invalidateRoom(int roomId);
+  void reindexRoom(const MapRoom* room);
+  void removeRoom(int roomId);
+  QList<int> matchingRooms(const QString& name, const QString& description, const QStringList& exits) const;
+  void queueSearchUpdate();
+  MapSearch::MapChanges searchChanges(const QSet<int>& roomIds) const;
+  QColor cachedHeuristic(const QString& text) const;
 
   QSettings* mapFile;
   QMap<QString, int> roomCosts;
   QMap<QString, QColor> roomColors;
+  // colorHeuristic() only depends on its input, so results never go stale
+  mutable QHash<QString, QColor> heuristicColors;
   QMap<int, MapRoom> rooms;
+  mutable RoomIndex roomIndex;
   std::map<QString, MapZone> zones;
   bool gmcpMode;
   int autoRoomId;
-
-  std::unique_ptr<MapSearch> mapSearch;
+  QList<int> avoidRoomIds;
+
+  // The working search is only touched by the worker thread while an update
+  // runs. Queries are answered from the latest snapshot taken from it, which
+  // is null until the first update after loading a map finishes.
+  std::unique_ptr<MapSearch> workingSearch;
+  std::shared_ptr<MapSearch> mapSearch;
+  QFutureWatcher<bool>* searchWatcher;
+  QTimer* searchTimer;
+  QSet<int> pendingRoomIds;
+  QSet<const MapZone*> pendingZones;
+  bool searchPending;
   std::unique_ptr<MapLayout> mapLayout;
+  std::unique_ptr<WorldLayout> mapWorld;
 };
 
 #endif
@@ -1,5 +1,6 @@
 CLASSES += mapmanager mapzone mapsearch
 CLASSES += mudletimport explorehistory maplayout
-CLASSES += mapviewer automapper
+CLASSES += mapviewer automapper roomindex worldlayout
+CLASSES += distancefield
 
 addClasses()
@@ -4,23 +4,161 @@
 #include "algorithms.h"
 #include <QTimer>
 #include <QtDebug>
+#include <queue>
+#include <memory>
+#include <algorithm>
+#include <utility>
 
 using Clique = MapSearch::Clique;
 
+static constexpr int MAX_CACHED_ROUTES = 256;
+
+static inline bool isAvoided(const QBitArray& avoidZones, int zoneIndex)
+{
+  return zoneIndex >= 0 && zoneIndex < avoidZones.size() && avoidZones.testBit(zoneIndex);
+}
+
+// Cost models for searchGraph. The flags are resolved at compile time, so each
+// combination gets its own search loop without per-room branching.
+template <bool UNIFORM, bool AVOID_ROOMS>
+struct RouteCostModel {
+  const QBitArray& avoidZones;
+  const QBitArray& avoidRooms;
+
+  static constexpr bool uniform = UNIFORM;
+
+  inline int cost(int roomCost) const { return UNIFORM ? 1 : roomCost; }
+  inline bool avoid(int roomId, int zoneIndex) const {
+    return isAvoided(avoidZones, zoneIndex) || (AVOID_ROOMS && isAvoided(avoidRooms, roomId));
+  }
+};
+
 MapSearch::MapSearch(MapManager* map)
-: map(map)
+: nextCliqueId(0), map(map)
 {
   dirtyZones << nullptr;
 }
 
+void MapSearch::applyChanges(const MapChanges& changes)
+{
+  data.zones = changes.zones;
+  data.roomCosts = changes.roomCosts;
+  data.gmcpMode = changes.gmcpMode;
+  setAvoidRooms(changes.avoidRooms);
+
+  for (int roomId : changes.removedRoomIds) {
+    auto iter = data.rooms.find(roomId);
+    if (iter != data.rooms.end()) {
+      data.zoneRoomIds[iter->zone.simplified()].remove(roomId);
+      data.rooms.erase(iter);
+    }
+    markRoomDirty(roomId);
+  }
+  for (const MapRoom& room : changes.rooms) {
+    auto iter = data.rooms.find(room.id);
+    if (iter != data.rooms.end()) {
+      data.zoneRoomIds[iter->zone.simplified()].remove(room.id);
+    }
+    data.rooms[room.id] = room;
+    if (changes.zoneRoomIds.contains(room.id)) {
+      data.zoneRoomIds[room.zone.simplified()] << room.id;
+    }
+    markRoomDirty(room.id);
+  }
+}
+
+const MapRoom* MapSearch::room(int roomId) const
+{
+  auto iter = data.rooms.constFind(roomId);
+  if (iter == data.rooms.constEnd()) {
+    return nullptr;
+  }
+  return &*iter;
+}
+
+const MapSearch::ZoneInfo* MapSearch::zone(const QString& name) const
+{
+  auto iter = data.zones.constFind(name.simplified());
+  if (iter == data.zones.constEnd()) {
+    return nullptr;
+  }
+  return &*iter;
+}
+
+MapSearch* MapSearch::snapshot() const
+{
+  // Every container here is implicitly shared and cliques are shared by
+  // pointer, so nothing is copied until the working search changes it.
+  MapSearch* copy = new MapSearch(map);
+  copy->data = data;
+  copy->avoidRooms = avoidRooms;
+  copy->nodes = nodes;
+  copy->danglingExits = danglingExits;
+  copy->dirtyRoomIds = dirtyRoomIds;
+  copy->dirtyZones = dirtyZones;
+  copy->cliqueStore = cliqueStore;
+  copy->nextCliqueId = nextCliqueId;
+  copy->cliques = cliques;
+  copy->roomCliques = roomCliques;
+  copy->staleCliques = staleCliques;
+  copy->resetCliques = resetCliques;
+  copy->unroutedCliques = unroutedCliques;
+  copy->overlay = overlay;
+  return copy;
+}
+
+const Clique* MapSearch::cliqueById(int cliqueId) const
+{
+  auto iter = cliqueStore.constFind(cliqueId);
+  if (iter == cliqueStore.constEnd()) {
+    return nullptr;
+  }
+  return iter->get();
+}
+
+Clique* MapSearch::mutableClique(int cliqueId)
+{
+  auto iter = cliqueStore.find(cliqueId);
+  if (iter == cliqueStore.end()) {
+    return nullptr;
+  }
+  if (iter->use_count() > 1) {
+    // A published snapshot still holds this clique
+    *iter = std::make_shared<Clique>(**iter);
+  }
+  return iter->get();
+}
+
+void MapSearch::setAvoidRooms(const QList<int>& roomIds)
+{
+  // An empty bitmap selects the cost models that skip the room check
+  avoidRooms.clear();
+  for (int roomId : roomIds) {
+    if (roomId < 0) {
+      continue;
+    }
+    if (avoidRooms.size() <= roomId) {
+      avoidRooms.resize(roomId + 1);
+    }
+    avoidRooms.setBit(roomId);
+  }
+}
+
 void MapSearch::reset()
 {
   nodes.clear();
+  danglingExits.clear();
+  overlay.clear();
+  roomCliques.clear();
+  staleCliques.clear();
+  resetCliques.clear();
+  unroutedCliques.clear();
   cliques.clear();
   cliqueStore.clear();
-  pendingRoomIds.clear();
+  dirtyRoomIds.clear();
   dirtyZones.clear();
   dirtyZones << nullptr;
+  routeCache.clear();
 }
 
 void MapSearch::markDirty(const MapZone* zone)
@@ -28,123 +166,154 @@ void MapSearch::markDirty(const MapZone* zone)
   dirtyZones << zone;
 }
 
-bool MapSearch::precompute(bool force)
+void MapSearch::markRoomDirty(int roomId)
+{
+  dirtyRoomIds << roomId;
+}
+
+bool MapSearch::precompute(bool force, bool withRoutes)
 {
   force = force || nodes.isEmpty() || dirtyZones.contains(nullptr);
-  if (!force && dirtyZones.isEmpty()) {
-    return false;
-  }
+  bool changed = force || !dirtyZones.isEmpty() || !dirtyRoomIds.isEmpty();
 
   if (force) {
     reset();
-  } else {
+    QSet<int> roomIds;
+    for (int roomId : keys(data.rooms)) {
+      updateNode(roomId);
+      roomIds << roomId;
+    }
+    buildCliques(roomIds);
+  } else if (changed) {
+    QSet<int> roomIds = dirtyRoomIds;
+    for (int roomId : dirtyRoomIds) {
+      updateNode(roomId);
+    }
     for (const MapZone* zone : dirtyZones) {
-      auto zoneCliques = cliques.take(zone->name);
-      for (Clique::MRef clique : zoneCliques) {
-        for (auto iter = cliqueStore.begin(); iter != cliqueStore.end(); iter++) {
-          if (&*iter == clique) {
-            cliqueStore.erase(iter);
-            break;
-          }
-        }
+      // Rebuild the zone from scratch
+      for (int cliqueId : cliques.value(zone->name)) {
+        removeClique(cliqueId);
       }
+      roomIds += data.zoneRoomIds.value(zone->name);
     }
+    buildCliques(roomIds);
   }
 
-  for (const QString& zoneName : map->zoneNames()) {
-    getCliquesForZone(map->zone(zoneName));
-  }
-  for (Clique& clique : cliqueStore) {
-    resolveExits(&clique);
-  }
-
-  nodes.clear();
-  for (auto [roomId, room] : cpairs(map->rooms)) {
-    if (!nodes.contains(roomId)) {
-      generateNodes(&room);
-    }
+  dirtyRoomIds.clear();
+  dirtyZones.clear();
+  updateBoundaries();
+  if (withRoutes) {
+    updateRoutes();
   }
+  return changed;
+}
 
-  for (auto [nodeId, node] : cpairs(nodes)) {
-    for (int destId : node.exits) {
-      Node& dest = nodes[destId];
-      if (!dest.entrances.contains(nodeId)) {
-        dest.entrances << nodeId;
-      }
-    }
+bool MapSearch::isRoutable(const MapRoom* room) const
+{
+  const ZoneInfo* zone = this->zone(room->zone);
+  if (!zone || !data.zoneRoomIds.value(zone->name).contains(room->id)) {
+    return false;
   }
-
-  dirtyZones.clear();
-  return true;
+  return !data.gmcpMode || !(zone->name.isEmpty() || zone->name == "-");
 }
 
-Clique::MRef MapSearch::newClique(const MapZone* parent)
+int MapSearch::newClique(const ZoneInfo& parent)
 {
-  cliqueStore.push_back(Clique());
-  Clique::MRef clique = &cliqueStore.back();
+  std::shared_ptr<Clique> clique = std::make_shared<Clique>();
+  clique->id = nextCliqueId++;
   clique->zone = parent;
-  cliques[parent->name] << clique;
-  return clique;
+  cliqueStore[clique->id] = clique;
+  cliques[parent.name] << clique->id;
+  staleCliques << clique->id;
+  return clique->id;
 }
 
-void MapSearch::getCliquesForZone(const MapZone* zone)
+void MapSearch::removeClique(int cliqueId)
 {
-  if (cliques.contains(zone->name)) {
-    // already computed
+  std::shared_ptr<Clique> clique = cliqueStore.take(cliqueId);
+  if (!clique) {
     return;
   }
+  for (int roomId : clique->roomIds) {
+    if (roomCliques.value(roomId, -1) == cliqueId) {
+      roomCliques.remove(roomId);
+    }
+  }
+  for (int roomId : clique->overlayRoomIds) {
+    overlay.remove(roomId);
+  }
+  cliques[clique->zone.name].removeAll(cliqueId);
+  staleCliques.remove(cliqueId);
+  resetCliques.remove(cliqueId);
+  unroutedCliques.remove(cliqueId);
+}
 
-  QSet<int> allExits;
-  for (const QSet<int>& exitGroup : zone->exits) {
-    allExits += exitGroup;
+int MapSearch::uniteCliques(int cliqueId, int otherId)
+{
+  if (cliqueId == otherId) {
+    return cliqueId;
+  }
+  if (cliqueById(cliqueId)->roomIds.size() < cliqueById(otherId)->roomIds.size()) {
+    std::swap(cliqueId, otherId);
   }
+  Clique* clique = mutableClique(cliqueId);
+  const Clique* other = cliqueById(otherId);
+  for (int roomId : other->roomIds) {
+    roomCliques[roomId] = cliqueId;
+  }
+  clique->roomIds.unite(other->roomIds);
+  // The larger clique's routes are still valid paths; shorter ones have to use the new rooms
+  clique->changedRoomIds.unite(other->roomIds);
+  removeClique(otherId);
+  staleCliques << cliqueId;
+  return cliqueId;
+}
 
-  pendingRoomIds = zone->roomIds;
+void MapSearch::splitClique(int cliqueId)
+{
+  // Membership can't be split in place, so rebuild just these rooms
+  QSet<int> roomIds = cliqueById(cliqueId)->roomIds;
+  removeClique(cliqueId);
+  buildCliques(roomIds);
+}
 
-  for (int exit : allExits) {
-    if (!pendingRoomIds.contains(exit)) {
-      // already part of a clique
-      continue;
+void MapSearch::buildCliques(const QSet<int>& roomIds)
+{
+  for (int roomId : roomIds) {
+    const MapRoom* room = this->room(roomId);
+    const Clique* clique = roomClique(roomId);
+    bool routable = room && isRoutable(room);
+    if (clique && (!routable || clique->zone.name != zone(room->zone)->name)) {
+      // The room was removed or moved to another zone. Cliques with exits into
+      // it need their exit lists rebuilt so they don't refer to the old clique.
+      for (int sourceId : nodes.value(roomId).entrances) {
+        int sourceCliqueId = roomCliques.value(sourceId, -1);
+        if (sourceCliqueId >= 0 && sourceCliqueId != clique->id) {
+          staleCliques << sourceCliqueId;
+        }
+      }
+      splitClique(clique->id);
+      clique = roomClique(roomId);
+    }
+    if (!clique && routable) {
+      int cliqueId = newClique(*zone(room->zone));
+      mutableClique(cliqueId)->roomIds << roomId;
+      roomCliques[roomId] = cliqueId;
     }
-    Clique::MRef clique = newClique(zone);
-    pendingRoomIds.remove(exit);
-    clique->roomIds << exit;
-    crawlClique(clique, exit);
   }
 
-  // operate on a copy because it can get modified
-  for (int roomId : QSet<int>(pendingRoomIds)) {
-    if (!pendingRoomIds.contains(roomId)) {
-      // removed by another call
+  // Cliques are the connected components of each zone, ignoring direction
+  for (int roomId : roomIds) {
+    int cliqueId = roomCliques.value(roomId, -1);
+    if (cliqueId < 0) {
       continue;
     }
-    Clique::MRef clique = newClique(zone);
-    clique->roomIds << roomId;
-    crawlClique(clique, roomId);
-
-    // Check for clique intersections and merge if needed
-    for (Clique::MRef other : QList<Clique::MRef>(cliques[zone->name])) {
-      if (clique == other || !clique->roomIds.intersects(other->roomIds)) {
-        continue;
-      }
-      other->roomIds.unite(clique->roomIds);
-      for (const CliqueExit& exit : clique->exits) {
-        bool found = false;
-        for (const CliqueExit& oexit : other->exits) {
-          if (exit.fromRoomId == oexit.fromRoomId && exit.toRoomId == oexit.toRoomId) {
-            found = true;
-            break;
-          }
-        }
-        if (!found) {
-          other->exits << exit;
-        }
-      }
-      cliques[zone->name].removeAll(clique);
-      for (auto iter = cliqueStore.begin(); iter != cliqueStore.end(); iter++) {
-        if (&*iter == clique) {
-          cliqueStore.erase(iter);
-          break;
+    Node node = nodes.value(roomId);
+    for (const QVector<int>& links : { node.exits, node.entrances }) {
+      for (int otherId : links) {
+        int otherCliqueId = roomCliques.value(otherId, -1);
+        if (otherCliqueId >= 0 && otherCliqueId != cliqueId && cliqueById(otherCliqueId)->zone.name == cliqueById(cliqueId)->zone.name) {
+          cliqueId = uniteCliques(cliqueId, otherCliqueId);
         }
       }
     }
@@ -154,110 +323,286 @@ void MapSearch::getCliquesForZone(const MapZone* zone)
 QList<Clique::Ref> MapSearch::cliquesForZone(const MapZone* zone) const
 {
   QList<Clique::Ref> result;
-  for (Clique::Ref clique : cliques.value(zone->name)) {
-    result << clique;
+  for (int cliqueId : cliques.value(zone->name)) {
+    Clique::Ref clique = cliqueStore.value(cliqueId);
+    if (clique) {
+      result << clique;
+    }
   }
   return result;
 }
 
-void MapSearch::crawlClique(Clique::MRefR clique, int roomId)
+bool MapSearch::resolveExits(int cliqueId)
 {
-  const MapRoom* room = map->room(roomId);
-  if (!room) {
-    // invalid room
-    return;
-  }
-  for (int exit : room->exitRooms()) {
-    const MapRoom* dest = map->room(exit);
-    if (!dest) {
-      continue;
-    }
-    if (dest->zone == clique->zone->name) {
-      if (clique->roomIds.contains(exit)) {
+  const Clique* clique = cliqueById(cliqueId);
+  QList<CliqueExit> exits;
+  QSet<int> exitRoomIds;
+  for (int roomId : clique->roomIds) {
+    for (int destId : nodes.value(roomId).exits) {
+      if (clique->roomIds.contains(destId)) {
+        continue;
+      }
+      int toCliqueId = roomCliques.value(destId, -1);
+      if (toCliqueId < 0) {
+        // destination isn't part of a routable zone
         continue;
       }
-      clique->roomIds << exit;
-      pendingRoomIds.remove(exit);
-      crawlClique(clique, exit);
+      exits << (CliqueExit){ roomId, toCliqueId, destId };
+      exitRoomIds << roomId;
     }
   }
-  // Check for rooms that connect to this clique that we missed
-  // (perhaps because of one-way connections)
-  bool extended = true;
-  while (extended) {
-    extended = false;
-    // Iterate over a copy
-    for (int pendingId : QSet<int>(pendingRoomIds)) {
-      if (!pendingRoomIds.contains(pendingId)) {
-        // removed by a recursive call
-        continue;
+  if (exits == clique->exits) {
+    // Leave cliques that a snapshot shares alone unless something changed
+    return false;
+  }
+
+  // Routes to rooms that stopped being exits are pruned in updateBoundaries, and
+  // routes to new exits are added in updateRoutes
+  Clique* target = mutableClique(cliqueId);
+  target->exits = exits;
+  target->exitRoomIds = exitRoomIds;
+  return true;
+}
+
+static void pruneRoutes(QMap<QPair<int, int>, MapSearch::Route>* routes, const QSet<int>& entryRoomIds, const QSet<int>& exitRoomIds)
+{
+  for (auto iter = routes->begin(); iter != routes->end(); ) {
+    if (entryRoomIds.contains(iter.key().first) && exitRoomIds.contains(iter.key().second)) {
+      ++iter;
+    } else {
+      iter = routes->erase(iter);
+    }
+  }
+}
+
+void MapSearch::updateBoundaries()
+{
+  if (staleCliques.isEmpty()) {
+    return;
+  }
+
+  for (int cliqueId : resetCliques) {
+    Clique* clique = mutableClique(cliqueId);
+    clique->routes.clear();
+    clique->uniformRoutes.clear();
+    clique->routedRoomIds.clear();
+    clique->routedExitIds.clear();
+    clique->changedRoomIds.clear();
+  }
+  resetCliques.clear();
+
+  // Cliques next to a changed clique may have exits that lead into it
+  QSet<int> refresh = staleCliques;
+  for (int cliqueId : staleCliques) {
+    for (int roomId : cliqueById(cliqueId)->roomIds) {
+      for (int sourceId : nodes.value(roomId).entrances) {
+        int sourceCliqueId = roomCliques.value(sourceId, -1);
+        if (sourceCliqueId >= 0) {
+          refresh << sourceCliqueId;
+        }
       }
-      const MapRoom* room = map->room(pendingId);
-      if (!room) {
-        continue;
+    }
+  }
+  QSet<int> boundaryChanged = staleCliques;
+  QSet<int> neighbors = refresh;
+  for (int cliqueId : refresh) {
+    if (resolveExits(cliqueId)) {
+      boundaryChanged << cliqueId;
+    }
+    for (const CliqueExit& exit : cliqueById(cliqueId)->exits) {
+      neighbors << exit.toCliqueId;
+    }
+  }
+
+  for (int cliqueId : neighbors) {
+    const Clique* clique = cliqueById(cliqueId);
+    QSet<int> entryRoomIds;
+    for (int roomId : clique->roomIds) {
+      for (int sourceId : nodes.value(roomId).entrances) {
+        int sourceCliqueId = roomCliques.value(sourceId, -1);
+        if (sourceCliqueId >= 0 && sourceCliqueId != cliqueId) {
+          entryRoomIds << roomId;
+          break;
+        }
       }
-      for (const MapExit& exit : room->exits) {
-        if (!clique->roomIds.contains(exit.dest)) {
-          // this exit doesn't connect to anything in the clique
+    }
+    if (entryRoomIds == clique->entryRoomIds && !boundaryChanged.contains(cliqueId)) {
+      continue;
+    }
+    Clique* target = mutableClique(cliqueId);
+    target->entryRoomIds = entryRoomIds;
+    pruneRoutes(&target->routes, target->entryRoomIds, target->exitRoomIds);
+    pruneRoutes(&target->uniformRoutes, target->entryRoomIds, target->exitRoomIds);
+    target->routedRoomIds.intersect(target->entryRoomIds);
+    target->routedExitIds.intersect(target->exitRoomIds);
+    boundaryChanged << cliqueId;
+  }
+
+  unroutedCliques += boundaryChanged;
+  staleCliques.clear();
+}
+
+// Follows a via chain from a search rooted at toId, collecting the rooms from fromId up to but not including toId
+static QList<int> walkVia(const QHash<int, int>& via, int fromId, int toId)
+{
+  QList<int> rooms;
+  for (int step = fromId; step != toId; step = via[step]) {
+    rooms << step;
+  }
+  return rooms;
+}
+
+template <typename Model>
+void MapSearch::updateCliqueRoutes(const Clique* clique, const Model& model, QMap<QPair<int, int>, Route>* routes) const
+{
+  QSet<int> oldEntries = QSet<int>(clique->entryRoomIds).intersect(clique->routedRoomIds);
+  QSet<int> oldExits = QSet<int>(clique->exitRoomIds).intersect(clique->routedExitIds);
+
+  // The stored routes between rooms that were already routed are still valid
+  // paths, since nothing was taken away. A shorter one has to pass through a
+  // changed room, so it's the sum of the best route to and from that room.
+  if (!oldEntries.isEmpty() && !oldExits.isEmpty()) {
+    for (int pivotId : clique->changedRoomIds) {
+      QHash<int, int> toVia, fromVia;
+      QHash<int, int> toCosts = localCosts(clique, pivotId, true, model, &toVia);
+      QHash<int, int> fromCosts = localCosts(clique, pivotId, false, model, &fromVia);
+      for (int entryId : oldEntries) {
+        if (!toCosts.contains(entryId)) {
           continue;
         }
-        const MapRoom* dest = map->room(exit.dest);
-        if (!dest || dest->zone != clique->zone->name) {
-          continue;
+        for (int exitId : oldExits) {
+          if (exitId == entryId || !fromCosts.contains(exitId)) {
+            continue;
+          }
+          int cost = toCosts[entryId] + fromCosts[exitId];
+          auto key = qMakePair(entryId, exitId);
+          auto iter = routes->constFind(key);
+          if (iter != routes->constEnd() && iter->cost <= cost) {
+            continue;
+          }
+          Route route;
+          route.cost = cost;
+          route.rooms = walkVia(toVia, entryId, pivotId);
+          route.rooms << pivotId;
+          QList<int> tail = walkVia(fromVia, exitId, pivotId);
+          std::reverse(tail.begin(), tail.end());
+          route.rooms += tail;
+          (*routes)[key] = route;
         }
-        extended = true;
-        clique->roomIds << pendingId;
-        pendingRoomIds.remove(pendingId);
-        crawlClique(clique, exit.dest);
       }
     }
   }
-}
 
-void MapSearch::resolveExits(Clique::MRefR clique)
-{
-  for (auto [zoneId, exitRoomIds] : cpairs(clique->zone->exits)) {
-    const MapZone* destZone = map->zone(zoneId);
-    if (!destZone) {
+  // New entry rooms get a full search to every exit
+  for (int entryId : clique->entryRoomIds) {
+    if (oldEntries.contains(entryId)) {
       continue;
     }
-    for (int roomId : exitRoomIds) {
-      if (!clique->roomIds.contains(roomId)) {
-        // exit belongs to a different clique
+    QHash<int, int> via;
+    QHash<int, int> costs = localCosts(clique, entryId, false, model, &via);
+    for (int exitId : clique->exitRoomIds) {
+      if (exitId == entryId || !costs.contains(exitId)) {
         continue;
       }
-      const MapRoom* room = map->room(roomId);
-      if (!room) {
+      Route route;
+      route.cost = costs[exitId];
+      route.rooms = walkVia(via, exitId, entryId);
+      route.rooms << entryId;
+      std::reverse(route.rooms.begin(), route.rooms.end());
+      (*routes)[qMakePair(entryId, exitId)] = route;
+    }
+  }
+
+  // New exit rooms get a reverse search from the exit back to the old entries
+  for (int exitId : clique->exitRoomIds) {
+    if (oldExits.contains(exitId) || oldEntries.isEmpty()) {
+      continue;
+    }
+    QHash<int, int> via;
+    QHash<int, int> costs = localCosts(clique, exitId, true, model, &via);
+    for (int entryId : oldEntries) {
+      if (entryId == exitId || !costs.contains(entryId)) {
         continue;
       }
-      for (const MapExit& exit : room->exits) {
-        const MapRoom* dest = map->room(exit.dest);
-        if (dest && dest->zone == zoneId) {
-          Clique::MRef toClique = findClique(zoneId, exit.dest);
-          if (!toClique) {
-            qDebug() << "XXX: broken clique, debug this";
-            continue;
-          }
-          clique->exits << (CliqueExit){ roomId, toClique, exit.dest };
-        }
-      }
+      Route route;
+      route.cost = costs[entryId];
+      route.rooms = walkVia(via, entryId, exitId);
+      route.rooms << exitId;
+      (*routes)[qMakePair(entryId, exitId)] = route;
     }
   }
 }
 
-Clique::MRef MapSearch::findClique(const QString& zoneName, int roomId) const
+void MapSearch::updateRoutes()
 {
-  for (Clique::MRef clique : cliques.value(zoneName)) {
-    if (clique->roomIds.contains(roomId)) {
-      return clique;
+  QBitArray none;
+  RouteCostModel<false, false> terrain{ none, none };
+  RouteCostModel<true, false> uniform{ none, none };
+  for (int cliqueId : unroutedCliques) {
+    Clique* clique = mutableClique(cliqueId);
+    bool unitCosts = true;
+    for (int roomId : clique->roomIds) {
+      if (nodes.value(roomId).cost != 1) {
+        unitCosts = false;
+        break;
+      }
+    }
+    if (unitCosts) {
+      clique->uniformRoutes.clear();
+    }
+
+    // Each changed room costs two searches, as does each new entry or exit
+    // room with the reverse search. Start over if that's no cheaper.
+    int newRooms = (clique->entryRoomIds - clique->routedRoomIds).size() + (clique->exitRoomIds - clique->routedExitIds).size();
+    bool restart = 2 * clique->changedRoomIds.size() + newRooms >= clique->entryRoomIds.size();
+    // A room that doesn't cost 1 joined a clique that didn't need uniform routes before
+    restart = restart || (!unitCosts && clique->uniformRoutes.isEmpty() && !clique->routes.isEmpty());
+    if (restart) {
+      clique->routes.clear();
+      clique->uniformRoutes.clear();
+      clique->routedRoomIds.clear();
+      clique->routedExitIds.clear();
+    }
+    if (!clique->changedRoomIds.isEmpty() || clique->routedRoomIds != clique->entryRoomIds || clique->routedExitIds != clique->exitRoomIds) {
+      updateCliqueRoutes(clique, terrain, &clique->routes);
+      if (!unitCosts) {
+        updateCliqueRoutes(clique, uniform, &clique->uniformRoutes);
+      }
+    }
+    clique->routedRoomIds = clique->entryRoomIds;
+    clique->routedExitIds = clique->exitRoomIds;
+    clique->changedRoomIds.clear();
+
+    for (int roomId : clique->overlayRoomIds) {
+      overlay.remove(roomId);
+    }
+    clique->overlayRoomIds.clear();
+    for (auto [key, route] : cpairs(clique->routes)) {
+      int uniformCost = unitCosts ? route.cost : clique->uniformRoutes.value(key).cost;
+      overlay[key.first] << (OverlayEdge){ key.second, route.cost, uniformCost, cliqueId };
+      clique->overlayRoomIds << key.first;
+    }
+    for (const CliqueExit& exit : clique->exits) {
+      overlay[exit.fromRoomId] << (OverlayEdge){ exit.toRoomId, nodes.value(exit.toRoomId).cost, 1, -1 };
+      clique->overlayRoomIds << exit.fromRoomId;
     }
   }
+
+  unroutedCliques.clear();
+}
+
+Clique::Ref MapSearch::findClique(const QString& zoneName, int roomId) const
+{
+  Clique::Ref clique = cliqueStore.value(roomCliques.value(roomId, -1));
+  if (clique && clique->zone.name == zoneName) {
+    return clique;
+  }
   return nullptr;
 }
 
-Clique::MRef MapSearch::findClique(int roomId) const
+Clique::Ref MapSearch::findClique(int roomId) const
 {
-  const MapRoom* room = map->room(roomId);
+  const MapRoom* room = this->room(roomId);
   if (!room) {
     return nullptr;
   }
@@ -320,38 +665,103 @@ QList<Clique::Ref> MapSearch::collectCliques(const QStringList& zones) const
 {
   QList<Clique::Ref> result;
   for (const QString& zone : zones) {
-    for (Clique::RefR clique : cliques.value(zone)) {
-      result << clique;
+    for (int cliqueId : cliques.value(zone)) {
+      result << cliqueStore.value(cliqueId);
     }
   }
   return result;
 }
 
-void MapSearch::generateNodes(const MapRoom* start)
+void MapSearch::updateNode(int roomId)
 {
-  Node& node = nodes[start->id];
-  if (node.roomId < 0) {
-    node.roomId = start->id;
-    node.cost = map->roomCosts.value(start->roomType);
-    if (!node.cost) {
-      node.cost = 1;
+  const MapRoom* room = this->room(roomId);
+  Node& node = nodes[roomId];
+  QVector<int> oldExits = node.exits;
+  int oldCost = node.cost;
+  node.roomId = room ? roomId : -1;
+  node.exits.clear();
+  if (room) {
+    const ZoneInfo* zone = this->zone(room->zone);
+    node.zoneIndex = zone ? zone->index : -1;
+    node.cost = qMax(data.roomCosts.value(room->roomType), 1);
+    for (const MapExit& exit : room->exits) {
+      if (exit.dest < 0 || node.exits.contains(exit.dest)) {
+        continue;
+      }
+      if (!this->room(exit.dest)) {
+        // Link it up when the room shows up
+        danglingExits[exit.dest] << roomId;
+        continue;
+      }
+      node.exits << exit.dest;
     }
   }
 
-  for (auto [dir, exit] : cpairs(start->exits)) {
-    int destId = exit.dest;
-    if (destId < 0) {
-      continue;
+  int cliqueId = roomCliques.value(roomId, -1);
+  bool split = false;
+  bool removed = !room || node.cost != oldCost;
+  bool added = false;
+  for (int destId : oldExits) {
+    if (!node.exits.contains(destId)) {
+      nodes[destId].entrances.removeAll(roomId);
+      split = split || (cliqueId >= 0 && roomCliques.value(destId, -1) == cliqueId);
+      removed = true;
     }
-    const MapRoom* dest = map->room(destId);
-    if (!dest) {
-      continue;
+  }
+  for (int destId : node.exits) {
+    Node& dest = nodes[destId];
+    if (!dest.entrances.contains(roomId)) {
+      dest.entrances << roomId;
     }
-    if (!node.exits.contains(destId)) {
-      node.exits << destId;
+    added = added || !oldExits.contains(destId);
+  }
+  if (!room) {
+    // Rooms that led here lose that exit until the room shows up again
+    for (int sourceId : std::exchange(node.entrances, {})) {
+      nodes[sourceId].exits.removeAll(roomId);
+      danglingExits[roomId] << sourceId;
+      int sourceCliqueId = roomCliques.value(sourceId, -1);
+      if (sourceCliqueId >= 0) {
+        staleCliques << sourceCliqueId;
+        resetCliques << sourceCliqueId;
+      }
     }
-    if (!nodes.contains(destId)) {
-      generateNodes(dest);
+  } else {
+    for (int sourceId : danglingExits.take(roomId)) {
+      const MapRoom* source = this->room(sourceId);
+      Node& sourceNode = nodes[sourceId];
+      if (!source || !source->hasExitTo(roomId) || sourceNode.exits.contains(roomId)) {
+        continue;
+      }
+      sourceNode.exits << roomId;
+      if (!node.entrances.contains(sourceId)) {
+        node.entrances << sourceId;
+      }
+    }
+  }
+
+  if (room && node.cost != oldCost) {
+    // Overlay edges that cross into this room from other cliques carry its cost
+    for (int sourceId : node.entrances) {
+      int sourceCliqueId = roomCliques.value(sourceId, -1);
+      if (sourceCliqueId >= 0 && sourceCliqueId != cliqueId) {
+        unroutedCliques << sourceCliqueId;
+      }
+    }
+  }
+
+  if (cliqueId >= 0) {
+    staleCliques << cliqueId;
+    if (removed) {
+      // Stored routes may use the connection that was taken away
+      resetCliques << cliqueId;
+    } else if (added) {
+      // Every new connection leaves this room, so new shortcuts pass through it
+      mutableClique(cliqueId)->changedRoomIds << roomId;
+    }
+    if (split) {
+      // A removed connection might have cut the clique in two
+      splitClique(cliqueId);
     }
   }
 }
@@ -368,113 +778,416 @@ struct StackCounter
   QByteArray indent;
 };
 
-QHash<int, int> MapSearch::costsFromNode(int startRoomId, bool reverse, const QSet<int>& avoidRooms) const
+template <typename Model>
+QHash<int, int> MapSearch::localCosts(const Clique* clique, int startRoomId, bool reverse, const Model& model, QHash<int, int>* via, int targetRoomId) const
 {
+  // Dijkstra search confined to a single clique. Costs are the sum of
+  // the rooms entered along the way, so the start room is free.
+  using Entry = std::pair<int, int>;
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
   QHash<int, int> costs;
-  costs[startRoomId] = 1;
-  QSet<int> frontier({ startRoomId });
-  while (!frontier.isEmpty()) {
-    QSet<int> newFrontier;
-    for (int roomId : frontier) {
-      int baseCost = costs[roomId];
-      const Node& node = nodes.value(roomId);
-      for (int destId : (reverse ? node.entrances : node.exits)) {
-        if (avoidRooms.contains(destId)) {
-          continue;
-        }
-        const Node& dest = nodes.value(destId);
-        int newCost = baseCost + dest.cost;
-        int oldCost = costs.value(destId, -1);
-        if (oldCost < 0 || newCost < oldCost) {
-          costs[destId] = newCost;
-          newFrontier << destId;
+  costs[startRoomId] = 0;
+  queue.push({ 0, startRoomId });
+  while (!queue.empty()) {
+    auto [cost, roomId] = queue.top();
+    queue.pop();
+    if (cost > costs.value(roomId)) {
+      // stale queue entry
+      continue;
+    }
+    auto iter = nodes.find(roomId);
+    if (iter == nodes.end()) {
+      continue;
+    }
+    const Node& node = *iter;
+    for (int nextId : (reverse ? node.entrances : node.exits)) {
+      if (clique && !clique->roomIds.contains(nextId)) {
+        continue;
+      }
+      const Node& next = nodes.value(nextId);
+      if (nextId != targetRoomId && model.avoid(nextId, next.zoneIndex)) {
+        continue;
+      }
+      int newCost = cost + model.cost(reverse ? node.cost : next.cost);
+      auto oldCost = costs.find(nextId);
+      if (oldCost == costs.end() || newCost < *oldCost) {
+        costs[nextId] = newCost;
+        if (via) {
+          (*via)[nextId] = roomId;
         }
+        queue.push({ newCost, nextId });
       }
     }
-    frontier = newFrontier;
   }
   return costs;
 }
 
-QPair<QList<int>, int> MapSearch::findRoute(int startRoomId, int endRoomId, const QSet<int>& avoidRooms) const
+QBitArray MapSearch::avoidMask(const QStringList& avoidZones, int startRoomId, int endRoomId, const ZoneInfo* destZone) const
 {
-  QHash<int, int> costs = costsFromNode(endRoomId, true, avoidRooms);
-  if (!costs.contains(startRoomId)) {
+  QBitArray result;
+  for (const QString& zoneName : avoidZones) {
+    const ZoneInfo* zone = this->zone(zoneName);
+    if (!zone || (destZone && zone->name == destZone->name)) {
+      continue;
+    }
+    QSet<int> zoneRoomIds = data.zoneRoomIds.value(zone->name);
+    if (zoneRoomIds.contains(startRoomId) || zoneRoomIds.contains(endRoomId)) {
+      continue;
+    }
+    if (result.size() <= zone->index) {
+      result.resize(zone->index + 1);
+    }
+    result.setBit(zone->index);
+  }
+  return result;
+}
+
+template <typename Model>
+QList<int> MapSearch::searchOverlay(int startRoomId, int endRoomId, const ZoneInfo* destZone, const Model& model, QList<Clique::Ref>* cliqueRoute) const
+{
+  const Clique* startClique = roomClique(startRoomId);
+  const Clique* endClique = endRoomId < 0 ? nullptr : roomClique(endRoomId);
+  if (!startClique || (endRoomId >= 0 && !endClique)) {
     return {};
   }
 
-  int traverse = startRoomId;
-  QList<int> route({ startRoomId });
-  while (traverse != endRoomId) {
-    const auto& node = nodes[traverse];
-    int bestExit = -1;
-    int bestCost = -1;
-    for (int exit : node.exits) {
-      if (route.contains(exit)) {
-        // this would be backtracking or sidetracking
-        continue;
+  QHash<int, int> startVia, endVia;
+  QHash<int, int> startCosts = localCosts(startClique, startRoomId, false, model, &startVia, endRoomId);
+  QHash<int, int> endCosts;
+  if (endClique) {
+    endCosts = localCosts(endClique, endRoomId, true, model, &endVia, startRoomId);
+  }
+
+  // Search the overlay graph, seeded with the exits reachable from the start room
+  using Entry = std::pair<int, int>;
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+  QHash<int, int> costs;
+  QHash<int, QPair<int, int>> prev;
+  int bestCost = -1;
+  int bestRoomId = -1;
+  bool direct = false;
+  if (endClique == startClique && startCosts.contains(endRoomId)) {
+    bestCost = startCosts[endRoomId];
+    direct = true;
+  }
+  for (int exitId : startClique->exitRoomIds) {
+    if (startCosts.contains(exitId)) {
+      costs[exitId] = startCosts[exitId];
+      queue.push({ costs[exitId], exitId });
+    }
+  }
+  while (!queue.empty()) {
+    auto [cost, roomId] = queue.top();
+    queue.pop();
+    if (cost > costs.value(roomId)) {
+      continue;
+    }
+    if (bestCost >= 0 && cost >= bestCost) {
+      break;
+    }
+    const Clique* clique = roomClique(roomId);
+    if (destZone && clique && clique->zone.name == destZone->name) {
+      bestCost = cost;
+      bestRoomId = roomId;
+      direct = false;
+      break;
+    }
+    if (clique && clique == endClique && endCosts.contains(roomId)) {
+      int total = cost + endCosts[roomId];
+      if (bestCost < 0 || total < bestCost) {
+        bestCost = total;
+        bestRoomId = roomId;
+        direct = false;
       }
-      int cost = costs[exit];
-      if (bestCost < 0 || cost < bestCost) {
-        bestExit = exit;
-        bestCost = cost;
+    }
+    for (const OverlayEdge& edge : overlay.value(roomId)) {
+      if (edge.cliqueId < 0) {
+        const Clique* toClique = roomClique(edge.toRoomId);
+        if (!toClique) {
+          continue;
+        }
+        bool isDest = edge.toRoomId == endRoomId || (destZone && toClique->zone.name == destZone->name);
+        if (!isDest && model.avoid(edge.toRoomId, toClique->zone.index)) {
+          continue;
+        }
+      }
+      // Avoided rooms inside the stored clique routes are checked once the route is expanded
+      int newCost = cost + (edge.cliqueId >= 0 ? (Model::uniform ? edge.uniformCost : edge.cost) : model.cost(edge.cost));
+      auto oldCost = costs.find(edge.toRoomId);
+      if (oldCost == costs.end() || newCost < *oldCost) {
+        costs[edge.toRoomId] = newCost;
+        prev[edge.toRoomId] = qMakePair(roomId, edge.cliqueId);
+        queue.push({ newCost, edge.toRoomId });
       }
     }
-    if (bestExit < 0) {
-      qDebug() << "XXX: no route";
-      return {};
+  }
+  if (bestCost < 0) {
+    return {};
+  }
+
+  QList<int> route;
+  if (direct) {
+    // The route never leaves the starting clique
+    for (int step = endRoomId; step != startRoomId; step = startVia[step]) {
+      route.prepend(step);
     }
-    route << bestExit;
-    traverse = bestExit;
+    route.prepend(startRoomId);
+    if (cliqueRoute) {
+      *cliqueRoute = { cliqueStore.value(startClique->id) };
+    }
+    return route;
+  }
+
+  // Expand the overlay path, walking backwards from the last boundary room
+  QList<int> tail;
+  int step = bestRoomId;
+  while (prev.contains(step)) {
+    auto [fromId, cliqueId] = prev[step];
+    if (cliqueId >= 0) {
+      const Clique* clique = cliqueById(cliqueId);
+      const auto& routes = Model::uniform && !clique->uniformRoutes.isEmpty() ? clique->uniformRoutes : clique->routes;
+      QList<int> rooms = routes.value(qMakePair(fromId, step)).rooms;
+      for (int i = rooms.length() - 1; i > 0; --i) {
+        tail.prepend(rooms[i]);
+      }
+    } else {
+      tail.prepend(step);
+      if (cliqueRoute) {
+        cliqueRoute->prepend(cliqueStore.value(roomCliques.value(step, -1)));
+      }
+    }
+    step = fromId;
   }
-  return qMakePair(route, costs[startRoomId]);
+  for (; step != startRoomId; step = startVia[step]) {
+    route.prepend(step);
+  }
+  route.prepend(startRoomId);
+  route += tail;
+  if (endClique) {
+    step = bestRoomId;
+    while (step != endRoomId) {
+      step = endVia[step];
+      route << step;
+    }
+  }
+  if (cliqueRoute) {
+    cliqueRoute->prepend(cliqueStore.value(startClique->id));
+  }
+  return route;
 }
 
-QList<int> MapSearch::findRoute(int startRoomId, int endRoomId, const QStringList& avoidZones) const
+QList<int> MapSearch::findOverlayRoute(int startRoomId, int endRoomId, const ZoneInfo* destZone, const QBitArray& avoidZones, CostModel model, QList<Clique::Ref>* cliqueRoute) const
 {
-  QSet<int> avoidRooms;
-  for (const QString& zoneName : avoidZones) {
-    const MapZone* zone = map->zone(zoneName);
-    if (zone && !zone->roomIds.contains(startRoomId) && !zone->roomIds.contains(endRoomId)) {
-      avoidRooms += zone->roomIds;
+  bool uniform = model == UniformCost;
+  if (avoidRooms.isEmpty()) {
+    if (uniform) {
+      return searchOverlay(startRoomId, endRoomId, destZone, RouteCostModel<true, false>{ avoidZones, avoidRooms }, cliqueRoute);
     }
+    return searchOverlay(startRoomId, endRoomId, destZone, RouteCostModel<false, false>{ avoidZones, avoidRooms }, cliqueRoute);
+  }
+  if (uniform) {
+    return searchOverlay(startRoomId, endRoomId, destZone, RouteCostModel<true, true>{ avoidZones, avoidRooms }, cliqueRoute);
+  }
+  return searchOverlay(startRoomId, endRoomId, destZone, RouteCostModel<false, true>{ avoidZones, avoidRooms }, cliqueRoute);
+}
+
+bool MapSearch::passesAvoidedRoom(const QList<int>& route) const
+{
+  // The ends of a route may be avoided rooms; only the rooms in between count
+  for (int i = 1; i < route.length() - 1; i++) {
+    if (isAvoided(avoidRooms, route[i])) {
+      return true;
+    }
+  }
+  return false;
+}
+
+QList<Clique::Ref> MapSearch::findCliqueRoute(int startRoomId, int endRoomId, const QStringList& avoidZones) const
+{
+  QList<Clique::Ref> result;
+  findOverlayRoute(startRoomId, endRoomId, nullptr, avoidMask(avoidZones, startRoomId, endRoomId), TerrainCost, &result);
+  return result;
+}
+
+const QList<int>* MapSearch::cachedRoute(const RouteKey& key) const
+{
+  auto iter = routeCache.constFind(key);
+  if (iter == routeCache.constEnd()) {
+    return nullptr;
   }
+  return &*iter;
+}
 
-  return findRoute(startRoomId, endRoomId, avoidRooms).first;
+void MapSearch::cacheRoute(const RouteKey& key, const QList<int>& route) const
+{
+  if (routeCache.size() >= MAX_CACHED_ROUTES) {
+    routeCache.clear();
+  }
+  routeCache[key] = route;
 }
 
-QList<int> MapSearch::findRoute(int startRoomId, const QString& destZone, const QStringList& avoidZones) const
+QList<int> MapSearch::findRoute(int startRoomId, int endRoomId, const QStringList& avoidZones, CostModel model) const
 {
-  const MapZone* zone = map->zone(destZone);
+  RouteKey key{ startRoomId, endRoomId, avoidMask(avoidZones, startRoomId, endRoomId), model };
+  if (const QList<int>* cached = cachedRoute(key)) {
+    return *cached;
+  }
+
+  QList<int> route;
+  bool flat = !roomCliques.contains(startRoomId) || !roomCliques.contains(endRoomId);
+  if (!flat) {
+    route = findOverlayRoute(startRoomId, endRoomId, nullptr, key.avoidZones, model);
+    // The stored clique routes don't know about avoided rooms. If the best
+    // route passes through one, search again without them.
+    flat = passesAvoidedRoom(route);
+  }
+  if (flat) {
+    route = findFlatRoute(startRoomId, { endRoomId }, model, key.avoidZones);
+  }
+  cacheRoute(key, route);
+  return route;
+}
+
+QList<int> MapSearch::findRoute(int startRoomId, const QString& destZone, const QStringList& avoidZones, CostModel model) const
+{
+  const ZoneInfo* zone = this->zone(destZone);
   if (!zone) {
     return {};
   }
 
-  QSet<int> avoidRooms;
-  for (const QString& zoneName : avoidZones) {
-    if (zoneName == destZone) {
+  RouteKey key{ startRoomId, -1 - zone->index, avoidMask(avoidZones, startRoomId, -1, zone), model };
+  if (const QList<int>* cached = cachedRoute(key)) {
+    return *cached;
+  }
+
+  QList<int> route;
+  bool flat = !roomCliques.contains(startRoomId);
+  if (!flat) {
+    route = findOverlayRoute(startRoomId, -1, zone, key.avoidZones, model);
+    flat = passesAvoidedRoom(route);
+  }
+  if (flat) {
+    route = findFlatRoute(startRoomId, data.zoneRoomIds.value(zone->name), model, key.avoidZones);
+  }
+  cacheRoute(key, route);
+  return route;
+}
+
+template <typename Model>
+QHash<int, int> MapSearch::searchGraph(const QSet<int>& startRoomIds, const QSet<int>& targetRoomIds, const Model& model, int* nearest, QHash<int, int>* via) const
+{
+  // Dijkstra search seeded from every start room. If nearest is provided, the
+  // search stops at the first target settled; otherwise it stops once every
+  // target has been settled, or runs to exhaustion if there are no targets.
+  // Targets may be entered even if the model avoids them. Without targets every
+  // room counts as one, so avoided rooms get a cost but aren't passed through.
+  using Entry = std::pair<int, int>;
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+  QHash<int, int> costs;
+  for (int roomId : startRoomIds) {
+    costs[roomId] = 0;
+    queue.push({ 0, roomId });
+  }
+  if (nearest) {
+    *nearest = -1;
+  }
+  int remaining = targetRoomIds.size();
+  QSet<int> settled;
+  while (!queue.empty()) {
+    auto [cost, roomId] = queue.top();
+    queue.pop();
+    if (cost > costs.value(roomId) || settled.contains(roomId)) {
+      // stale queue entry
       continue;
     }
-    const MapZone* zone = map->zone(zoneName);
-    if (zone && !zone->roomIds.contains(startRoomId)) {
-      avoidRooms += zone->roomIds;
+    settled << roomId;
+    if (targetRoomIds.contains(roomId)) {
+      if (nearest) {
+        *nearest = roomId;
+        break;
+      }
+      if (--remaining <= 0) {
+        break;
+      }
+    }
+    auto iter = nodes.find(roomId);
+    if (iter == nodes.end()) {
+      continue;
+    }
+    for (int nextId : iter->exits) {
+      const Node& next = nodes.value(nextId);
+      bool endpoint = model.avoid(nextId, next.zoneIndex) && !targetRoomIds.contains(nextId);
+      if (endpoint && !targetRoomIds.isEmpty()) {
+        continue;
+      }
+      int newCost = cost + model.cost(next.cost);
+      auto oldCost = costs.find(nextId);
+      if (oldCost == costs.end() || newCost < *oldCost) {
+        costs[nextId] = newCost;
+        if (via) {
+          (*via)[nextId] = roomId;
+        }
+        if (!endpoint) {
+          queue.push({ newCost, nextId });
+        }
+      }
     }
   }
+  return costs;
+}
 
-  QHash<int, int> forwardCosts = costsFromNode(startRoomId, false, avoidRooms);
-  int endRoomId = -1;
-  int bestCost = -1;
-  for (const QSet<int>& exits : zone->exits) {
-    for (int roomId : exits) {
-      int cost = forwardCosts[roomId];
-      if (bestCost < 0 || cost < bestCost) {
-        endRoomId = roomId;
-        bestCost = cost;
-      }
+QHash<int, int> MapSearch::multiSearch(const QSet<int>& startRoomIds, const QSet<int>& targetRoomIds, CostModel model, const QBitArray& avoidZones, int* nearest, QHash<int, int>* via) const
+{
+  bool uniform = model == UniformCost;
+  if (avoidRooms.isEmpty()) {
+    if (uniform) {
+      return searchGraph(startRoomIds, targetRoomIds, RouteCostModel<true, false>{ avoidZones, avoidRooms }, nearest, via);
     }
+    return searchGraph(startRoomIds, targetRoomIds, RouteCostModel<false, false>{ avoidZones, avoidRooms }, nearest, via);
+  }
+  if (uniform) {
+    return searchGraph(startRoomIds, targetRoomIds, RouteCostModel<true, true>{ avoidZones, avoidRooms }, nearest, via);
   }
+  return searchGraph(startRoomIds, targetRoomIds, RouteCostModel<false, true>{ avoidZones, avoidRooms }, nearest, via);
+}
 
-  return findRoute(startRoomId, endRoomId, avoidRooms).first;
+QList<int> MapSearch::findFlatRoute(int startRoomId, const QSet<int>& targetRoomIds, CostModel model, const QBitArray& avoidZones) const
+{
+  if (targetRoomIds.isEmpty()) {
+    return {};
+  }
+  int endRoomId = -1;
+  QHash<int, int> via;
+  multiSearch({ startRoomId }, targetRoomIds, model, avoidZones, &endRoomId, &via);
+  if (endRoomId < 0) {
+    return {};
+  }
+  QList<int> route({ endRoomId });
+  while (route.first() != startRoomId) {
+    route.prepend(via.value(route.first()));
+  }
+  return route;
+}
+
+QList<int> MapSearch::findNearest(int startRoomId, const QSet<int>& targetRoomIds, const QStringList& avoidZones, CostModel model) const
+{
+  return findFlatRoute(startRoomId, targetRoomIds, model, avoidMask(avoidZones, startRoomId, -1));
+}
+
+QHash<int, int> MapSearch::findDistances(int startRoomId, const QSet<int>& targetRoomIds, const QStringList& avoidZones, CostModel model) const
+{
+  QHash<int, int> costs = multiSearch({ startRoomId }, targetRoomIds, model, avoidMask(avoidZones, startRoomId, -1));
+  if (targetRoomIds.isEmpty()) {
+    return costs;
+  }
+  QHash<int, int> result;
+  for (int roomId : targetRoomIds) {
+    auto iter = costs.constFind(roomId);
+    if (iter != costs.constEnd()) {
+      result[roomId] = *iter;
+    }
+  }
+  return result;
 }
 
 QStringList MapSearch::routeDirections(const QList<int>& route) const
@@ -484,7 +1197,7 @@ QStringList MapSearch::routeDirections(const QList<int>& route) const
   }
   QStringList path;
   int startRoomId = route.first();
-  const MapRoom* room = map->room(startRoomId);
+  const MapRoom* room = this->room(startRoomId);
   for (int step : route) {
     if (step == startRoomId) {
       continue;
@@ -497,7 +1210,7 @@ QStringList MapSearch::routeDirections(const QList<int>& route) const
       return {};
     }
     path << dir;
-    room = map->room(step);
+    room = this->room(step);
   }
   return path;
 }
@@ -3,16 +3,16 @@
 
 #include <QObject>
 #include <QSet>
+#include <QHash>
 #include <QMultiMap>
 #include <QList>
 #include <QString>
 #include <QRect>
+#include <QBitArray>
 #include <QPair>
-#include <list>
-#include "refable.h"
+#include <memory>
+#include "mapzone.h"
 class MapManager;
-class MapZone;
-class MapRoom;
 
 class MapSearch : public QObject
 {
@@ -45,19 +45,48 @@ public:
     inline bool contains(const Grid& other) const { return rooms.contains(other.rooms); }
   };
 
+  // Zone identity copied out of MapManager, so searches don't point into live zones
+  struct ZoneInfo {
+    QString name;
+    int index = -1;
+  };
+
   struct CliqueExit;
-  struct Clique : public Refable<Clique> {
-    const MapZone* zone;
+  struct Clique {
+    // Published snapshots share cliques with the working search, which copies one before changing it
+    using Ref = std::shared_ptr<const Clique>;
+    using RefR = const Ref&;
+
+    int id = -1;
+    ZoneInfo zone;
     QSet<int> roomIds;
     QList<CliqueExit> exits;
+    // Rooms that can be entered from / exited to other cliques
+    QSet<int> entryRoomIds;
+    QSet<int> exitRoomIds;
+    // Shortest routes inside the clique from each entry room to each exit room
     QMap<QPair<int, int>, Route> routes;
+    // The same routes when every room costs 1. Left empty if every room in the clique costs 1 anyway.
+    QMap<QPair<int, int>, Route> uniformRoutes;
+    // Entry and exit rooms the stored routes cover
+    QSet<int> routedRoomIds;
+    QSet<int> routedExitIds;
+    // Rooms that gained connections since the routes were stored. Only
+    // routes through one of these can have become shorter.
+    QSet<int> changedRoomIds;
     QList<Grid> grids;
+    // Rooms whose overlay edges belong to this clique
+    QSet<int> overlayRoomIds;
   };
 
   struct CliqueExit {
     int fromRoomId;
-    Clique::MRef toClique;
+    int toCliqueId;
     int toRoomId;
+
+    inline bool operator==(const CliqueExit& other) const {
+      return fromRoomId == other.fromRoomId && toCliqueId == other.toCliqueId && toRoomId == other.toRoomId;
+    }
   };
 
   struct CliqueRoute {
@@ -65,43 +94,143 @@ public:
     int cost;
   };
 
+  enum CostModel {
+    TerrainCost, // Rooms cost what their room type costs
+    UniformCost, // Every room costs the same, i.e. for flying
+  };
+
+  // Map changes since the last update. The search keeps its own copy of the
+  // rooms, so precompute() never reads from MapManager and the live room
+  // table is never shared with the worker thread.
+  struct MapChanges {
+    // Rooms that were added or changed, and which of those belong to their zone
+    QHash<int, MapRoom> rooms;
+    QSet<int> zoneRoomIds;
+    QSet<int> removedRoomIds;
+    QHash<QString, ZoneInfo> zones;
+    QMap<QString, int> roomCosts;
+    QList<int> avoidRooms;
+    bool gmcpMode = false;
+  };
+
   MapSearch(MapManager* map);
 
+  void applyChanges(const MapChanges& changes);
+  MapSearch* snapshot() const;
   void reset();
   void markDirty(const MapZone* zone = nullptr);
-  bool precompute(bool force = false);
+  void markRoomDirty(int roomId);
+  bool precompute(bool force = false, bool withRoutes = true);
   QList<Clique::Ref> cliquesForZone(const MapZone* zone) const;
   QList<Clique::Ref> findCliqueRoute(int startRoomId, int endRoomId, const QStringList& avoidZones = {}) const;
-  QList<int> findRoute(int startRoomId, int endRoomId, const QStringList& avoidZones = {}) const;
-  QList<int> findRoute(int startRoomId, const QString& destZone, const QStringList& avoidZones = {}) const;
+  // Queries on a published snapshot share its route cache, so they must only be made from the GUI thread
+  QList<int> findRoute(int startRoomId, int endRoomId, const QStringList& avoidZones = {}, CostModel model = TerrainCost) const;
+  QList<int> findRoute(int startRoomId, const QString& destZone, const QStringList& avoidZones = {}, CostModel model = TerrainCost) const;
+  // Multi-target queries answered with a single search from the start room
+  QList<int> findNearest(int startRoomId, const QSet<int>& targetRoomIds, const QStringList& avoidZones = {}, CostModel model = TerrainCost) const;
+  QHash<int, int> findDistances(int startRoomId, const QSet<int>& targetRoomIds = {}, const QStringList& avoidZones = {}, CostModel model = TerrainCost) const;
   QStringList routeDirections(const QList<int>& route) const;
 
 private:
-  void getCliquesForZone(const MapZone* zone);
-  void crawlClique(Clique::MRefR clique, int roomId);
-  void resolveExits(Clique::MRefR clique);
+  struct MapData {
+    QMap<int, MapRoom> rooms;
+    QHash<QString, ZoneInfo> zones;
+    QHash<QString, QSet<int>> zoneRoomIds;
+    QMap<QString, int> roomCosts;
+    bool gmcpMode = false;
+  };
+  MapData data;
+  const MapRoom* room(int roomId) const;
+  const ZoneInfo* zone(const QString& name) const;
+  void setAvoidRooms(const QList<int>& roomIds);
+
+  void buildCliques(const QSet<int>& roomIds);
+  void splitClique(int cliqueId);
+  int uniteCliques(int cliqueId, int otherId);
+  void removeClique(int cliqueId);
+  bool isRoutable(const MapRoom* room) const;
+  bool resolveExits(int cliqueId);
+  void updateBoundaries();
+  void updateRoutes();
+  template <typename Model>
+  void updateCliqueRoutes(const Clique* clique, const Model& model, QMap<QPair<int, int>, Route>* routes) const;
   QMap<int, int> getCosts(Clique::RefR clique, int startRoomId, int endRoomId = -1) const;
-  Clique::MRef newClique(const MapZone* parent);
-  Clique::MRef findClique(const QString& zoneName, int roomId) const;
-  Clique::MRef findClique(int roomId) const;
+  int newClique(const ZoneInfo& parent);
+  Clique::Ref findClique(const QString& zoneName, int roomId) const;
+  Clique::Ref findClique(int roomId) const;
   QList<Clique::Ref> collectCliques(const QStringList& zones) const;
 
   struct Node {
     int roomId = -1;
-    int cost;
+    int zoneIndex = -1;
+    int cost = 1;
     QVector<int> exits;
     QVector<int> entrances;
   };
   QMap<int, Node> nodes;
-  void generateNodes(const MapRoom* start);
-  QHash<int, int> costsFromNode(int startRoomId, bool reverse, const QSet<int>& avoidRooms = {}) const;
-  QPair<QList<int>, int> findRoute(int startRoomId, int endRoomId, const QSet<int>& avoidRooms) const;
+  // Exits that point at rooms that haven't been seen yet
+  QHash<int, QSet<int>> danglingExits;
+  void updateNode(int roomId);
+  // Rooms that routes may start or end in but never pass through, indexed by room ID
+  QBitArray avoidRooms;
+  template <typename Model>
+  QHash<int, int> searchGraph(const QSet<int>& startRoomIds, const QSet<int>& targetRoomIds, const Model& model, int* nearest, QHash<int, int>* via) const;
+  QHash<int, int> multiSearch(const QSet<int>& startRoomIds, const QSet<int>& targetRoomIds, CostModel model, const QBitArray& avoidZones, int* nearest = nullptr, QHash<int, int>* via = nullptr) const;
+  QList<int> findFlatRoute(int startRoomId, const QSet<int>& targetRoomIds, CostModel model, const QBitArray& avoidZones) const;
+
+  // Edges of the overlay graph that connects clique boundary rooms
+  struct OverlayEdge {
+    int toRoomId;
+    int cost;
+    int uniformCost;
+    int cliqueId; // -1 when crossing between cliques
+  };
+  QHash<int, QVector<OverlayEdge>> overlay;
+  // Cliques by ID. Only the working search may call mutableClique().
+  QHash<int, std::shared_ptr<Clique>> cliqueStore;
+  int nextCliqueId;
+  const Clique* cliqueById(int cliqueId) const;
+  Clique* mutableClique(int cliqueId);
+  inline const Clique* roomClique(int roomId) const { return cliqueById(roomCliques.value(roomId, -1)); }
+  // Disjoint-set membership: every room maps to the ID of the clique representing its set.
+  // Merges move the smaller clique into the larger one.
+  QHash<int, int> roomCliques;
+  // Cliques whose boundary needs to be rebuilt
+  QSet<int> staleCliques;
+  // Cliques that lost a connection or had a room cost change, so their stored routes are discarded
+  QSet<int> resetCliques;
+  QSet<int> unroutedCliques;
+  // Searches within one clique. Avoided rooms are only entered if they're the target room.
+  template <typename Model>
+  QHash<int, int> localCosts(const Clique* clique, int startRoomId, bool reverse, const Model& model, QHash<int, int>* via = nullptr, int targetRoomId = -1) const;
+  QBitArray avoidMask(const QStringList& avoidZones, int startRoomId, int endRoomId, const ZoneInfo* destZone = nullptr) const;
+  template <typename Model>
+  QList<int> searchOverlay(int startRoomId, int endRoomId, const ZoneInfo* destZone, const Model& model, QList<Clique::Ref>* cliqueRoute) const;
+  QList<int> findOverlayRoute(int startRoomId, int endRoomId, const ZoneInfo* destZone, const QBitArray& avoidZones, CostModel model, QList<Clique::Ref>* cliqueRoute = nullptr) const;
+  bool passesAvoidedRoom(const QList<int>& route) const;
+
+  // Routes are cached for the lifetime of the snapshot. Zone routes use -1 - zone index as the destination.
+  struct RouteKey {
+    int startRoomId;
+    int dest;
+    QBitArray avoidZones;
+    CostModel model;
+
+    inline bool operator==(const RouteKey& other) const {
+      return startRoomId == other.startRoomId && dest == other.dest && avoidZones == other.avoidZones && model == other.model;
+    }
+    friend inline uint qHash(const RouteKey& key, uint seed = 0) {
+      return qHash(key.startRoomId, seed) ^ qHash(key.dest, seed) ^ qHash(key.avoidZones, seed) ^ qHash(int(key.model), seed);
+    }
+  };
+  mutable QHash<RouteKey, QList<int>> routeCache;
+  const QList<int>* cachedRoute(const RouteKey& key) const;
+  void cacheRoute(const RouteKey& key, const QList<int>& route) const;
 
 public:
   MapManager* map;
-  std::list<Clique> cliqueStore;
-  QMap<QString, QList<Clique::MRef>> cliques;
-  QSet<int> pendingRoomIds;
+  QMap<QString, QList<int>> cliques;
+  QSet<int> dirtyRoomIds;
   QSet<const MapZone*> dirtyZones;
 };
 
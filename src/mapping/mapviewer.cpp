@@ -1,6 +1,7 @@
 #include "mapviewer.h"
 #include "mapmanager.h"
 #include "explorehistory.h"
+#include "distancefield.h"
 #include "userprofile.h"
 #include "galoshsession.h"
 #include <QSettings>
@@ -8,6 +9,8 @@
 #include <QHBoxLayout>
 #include <QComboBox>
 #include <QToolButton>
+#include <QMenu>
+#include <QActionGroup>
 #include <QScrollBar>
 #include <QToolTip>
 #include <QPainter>
@@ -19,18 +22,24 @@ class MapWidget : public QWidget
 {
 public:
   MapWidget(MapViewer* parent)
-  : QWidget(parent), mapViewer(parent), mapLayout(nullptr), zoomLevel(5), currentRoomId(-1)
+  : QWidget(parent), mapViewer(parent), mapLayout(nullptr), worldLayout(nullptr), distances(nullptr), zoomLevel(5), currentRoomId(-1)
   {
     setMouseTracking(true);
   }
 
   MapViewer* mapViewer;
   MapLayout* mapLayout;
+  WorldLayout* worldLayout;
+  DistanceField* distances;
   double zoomLevel;
   int currentRoomId;
+  QString hoverZone;
 
   QSize sizeHint() const
   {
+    if (worldLayout) {
+      return worldLayout->displaySize() * zoomLevel;
+    }
     if (!mapLayout) {
       return QSize();
     }
@@ -46,6 +55,19 @@ public:
 protected:
   void mouseMoveEvent(QMouseEvent* event)
   {
+    if (worldLayout) {
+      QString zone = worldLayout->zoneAt(QPointF(event->pos()) / zoomLevel);
+      if (zone != hoverZone) {
+        hoverZone = zone;
+        mapViewer->highlightRoute(zone);
+      }
+      if (zone.isEmpty()) {
+        QToolTip::hideText();
+      } else {
+        QToolTip::showText(event->globalPos(), zone, this);
+      }
+      return;
+    }
     if (!mapLayout) {
       QToolTip::hideText();
       return;
@@ -59,15 +81,30 @@ protected:
       if (room->zone != mapLayout->currentZone) {
         label = QStringLiteral("%1: %2").arg(room->zone, label);
       }
+      if (distances && distances->cost(room->id) >= 0) {
+        label = QStringLiteral("%1\nDistance: %2").arg(label).arg(distances->cost(room->id));
+      }
       QToolTip::showText(event->globalPos(), label, this);
     } else {
       QToolTip::hideText();
     }
   }
 
+  void mousePressEvent(QMouseEvent* event)
+  {
+    if (!worldLayout || event->button() != Qt::LeftButton) {
+      QWidget::mousePressEvent(event);
+      return;
+    }
+    QString zone = worldLayout->zoneAt(QPointF(event->pos()) / zoomLevel);
+    if (!zone.isEmpty()) {
+      mapViewer->loadZone(zone);
+    }
+  }
+
   void mouseDoubleClickEvent(QMouseEvent* event)
   {
-    if (!mapLayout) {
+    if (!mapLayout || worldLayout) {
       return;
     }
 
@@ -85,15 +122,22 @@ protected:
 
   void paintEvent(QPaintEvent* event)
   {
+    if (worldLayout) {
+      QPainter p(this);
+      worldLayout->paint(&p, event->rect(), zoomLevel);
+      return;
+    }
     if (!mapLayout) {
       return;
     }
 
     QPainter p(this);
+    mapLayout->paint(&p, event->rect(), zoomLevel, mapViewer->mapType != MapViewer::MiniMap);
     p.scale(zoomLevel, zoomLevel);
-    QRect vp = event->rect();
-    vp = QRect(vp.left() / zoomLevel, vp.top() / zoomLevel, vp.width() / zoomLevel, vp.height() / zoomLevel);
-    mapLayout->render(&p, vp, mapViewer->mapType != MapViewer::MiniMap);
+
+    if (distances && distances->startRoomId() >= 0) {
+      paintDistances(&p, QRectF(QPointF(event->rect().topLeft()) / zoomLevel, QSizeF(event->rect().size()) / zoomLevel));
+    }
 
     QRectF highlight = mapLayout->roomPos(currentRoomId);
     if (!highlight.isNull()) {
@@ -103,10 +147,25 @@ protected:
       p.drawRect(highlight);
     }
   }
+
+  void paintDistances(QPainter* p, const QRectF& visible)
+  {
+    // Near rooms are green, the farthest reachable room in the zone is red
+    double scale = qMax(distances->maxCost(mapViewer->map->zone(mapLayout->currentZone)), 1);
+    p->setPen(Qt::NoPen);
+    for (int roomId : mapLayout->roomsIn(visible)) {
+      int cost = distances->cost(roomId);
+      if (cost < 0) {
+        continue;
+      }
+      p->setBrush(QColor::fromHsvF(qMax(0.0, 1 - cost / scale) / 3, 1, 1, 0.6));
+      p->drawRect(mapLayout->roomPos(roomId));
+    }
+  }
 };
 
 MapViewer::MapViewer(MapViewer::MapType mapType, QWidget* parent)
-: QWidget(parent), session(nullptr), map(nullptr), mapLayout(nullptr), mapType(mapType)
+: QWidget(parent), session(nullptr), map(nullptr), mapLayout(nullptr), worldButton(nullptr), uniformDistances(false), mapType(mapType)
 {
   if (mapType == StandaloneMap) {
     setAttribute(Qt::WA_WindowPropagation, true);
@@ -139,6 +198,33 @@ MapViewer::MapViewer(MapViewer::MapType mapType, QWidget* parent)
   zone->setInsertPolicy(QComboBox::InsertAlphabetically);
   layout->addWidget(zone, 1);
 
+  if (mapType != MiniMap) {
+    worldButton = new QToolButton(header);
+    worldButton->setText("World");
+    worldButton->setCheckable(true);
+    QObject::connect(worldButton, SIGNAL(toggled(bool)), this, SLOT(showWorld(bool)));
+    layout->addWidget(worldButton);
+  }
+
+  distanceButton = new QToolButton(header);
+  distanceButton->setText("Distance");
+  distanceButton->setCheckable(true);
+  distanceButton->setPopupMode(QToolButton::MenuButtonPopup);
+  QMenu* distanceMenu = new QMenu(distanceButton);
+  QActionGroup* distanceModels = new QActionGroup(distanceMenu);
+  QAction* terrainCost = distanceMenu->addAction("Terrain cost");
+  terrainCost->setCheckable(true);
+  terrainCost->setChecked(true);
+  distanceModels->addAction(terrainCost);
+  QAction* uniformCost = distanceMenu->addAction("Uniform cost");
+  uniformCost->setCheckable(true);
+  uniformCost->setData(true);
+  distanceModels->addAction(uniformCost);
+  distanceButton->setMenu(distanceMenu);
+  QObject::connect(distanceButton, SIGNAL(toggled(bool)), this, SLOT(showDistances(bool)));
+  QObject::connect(distanceModels, SIGNAL(triggered(QAction*)), this, SLOT(setDistanceModel(QAction*)));
+  layout->addWidget(distanceButton);
+
   QToolButton* bIn = new QToolButton(header);
   bIn->setText("+");
   QObject::connect(bIn, SIGNAL(clicked()), this, SLOT(zoomIn()));
@@ -154,6 +240,7 @@ MapViewer::MapViewer(MapViewer::MapType mapType, QWidget* parent)
     small.setPointSize(small.pointSize() * .75);
     bIn->setFont(small);
     bOut->setFont(small);
+    distanceButton->setFont(small);
     bIn->setFixedSize(bIn->minimumSizeHint());
     bOut->setFixedSize(bOut->minimumSizeHint());
     zone->setVisible(false);
@@ -202,7 +289,7 @@ void MapViewer::setZoom(double level)
   center /= view->zoomLevel;
   view->zoomLevel = level;
   if (mapLayout) {
-    view->resize(mapLayout->displaySize() * view->zoomLevel);
+    view->resize(view->sizeHint());
   }
   center *= view->zoomLevel;
   scrollArea->horizontalScrollBar()->setValue(center.x());
@@ -250,6 +337,10 @@ void MapViewer::setCurrentRoom(int roomId)
   if (view->currentRoomId != roomId) {
     loadZone(room->zone);
     view->currentRoomId = roomId;
+    if (distances) {
+      distances->setStart(roomId, uniformDistances ? MapSearch::UniformCost : MapSearch::TerrainCost);
+      view->update();
+    }
     QPointF pos = mapLayout->roomPos(roomId).center() * view->zoomLevel;
     scrollArea->ensureVisible(pos.x(), pos.y(), width() / 3, height() / 3);
   }
@@ -261,6 +352,9 @@ void MapViewer::loadZone(const QString& name, bool force)
   if (!mapLayout) {
     return;
   }
+  if (view->worldLayout) {
+    showWorld(false);
+  }
   if (zone->currentText() != name) {
     zone->blockSignals(true);
     if (zone->findText(name) < 0) {
@@ -276,11 +370,122 @@ void MapViewer::loadZone(const QString& name, bool force)
     zone->blockSignals(false);
   }
   mapLayout->loadZone(map->zone(name), force);
-  view->resize(mapLayout->displaySize() * view->zoomLevel);
+}
+
+void MapViewer::layoutUpdated()
+{
+  view->resize(view->sizeHint());
   resizeEvent(nullptr);
   view->update();
 }
 
+void MapViewer::showDistances(bool on)
+{
+  if (on && map) {
+    distances.reset(new DistanceField(map));
+    distances->setStart(view->currentRoomId, uniformDistances ? MapSearch::UniformCost : MapSearch::TerrainCost);
+  } else {
+    distances.reset();
+  }
+  view->distances = distances.get();
+  view->update();
+}
+
+void MapViewer::setDistanceModel(QAction* action)
+{
+  uniformDistances = action->data().toBool();
+  if (distances) {
+    distances->setStart(view->currentRoomId, uniformDistances ? MapSearch::UniformCost : MapSearch::TerrainCost);
+    view->update();
+  }
+}
+
+void MapViewer::roomUpdated(int roomId)
+{
+  if (distances) {
+    distances->roomChanged(roomId);
+    view->update();
+  }
+}
+
+void MapViewer::searchUpdated()
+{
+  if (distances && distances->isStale()) {
+    distances->recompute();
+    view->update();
+  }
+}
+
+void MapViewer::routingChanged()
+{
+  if (distances) {
+    // Avoided zones apply when searching, so rebuild now. Cost and avoided
+    // room changes only reach the search with the next snapshot.
+    distances->recompute();
+    distances->invalidate();
+    view->update();
+  }
+}
+
+void MapViewer::showWorld(bool on)
+{
+  if (on && !map) {
+    on = false;
+  }
+  if (worldButton) {
+    worldButton->blockSignals(true);
+    worldButton->setChecked(on);
+    worldButton->blockSignals(false);
+  }
+  if (on == (view->worldLayout != nullptr)) {
+    return;
+  }
+
+  if (on) {
+    WorldLayout* world = map->worldLayout();
+    world->update();
+    const MapRoom* room = session ? session->currentRoom() : nullptr;
+    world->currentZone = room ? room->zone : mapLayout->currentZone;
+    world->setRoute({});
+    view->worldLayout = world;
+  } else {
+    view->worldLayout = nullptr;
+  }
+  view->hoverZone.clear();
+  layoutUpdated();
+
+  QRectF focus = view->worldLayout ? view->worldLayout->zonePos(view->worldLayout->currentZone) : mapLayout->roomPos(view->currentRoomId);
+  if (!focus.isNull()) {
+    QPointF pos = focus.center() * view->zoomLevel;
+    scrollArea->ensureVisible(pos.x(), pos.y(), width() / 3, height() / 3);
+  }
+}
+
+void MapViewer::highlightRoute(const QString& destZone)
+{
+  WorldLayout* world = view->worldLayout;
+  const MapRoom* start = session ? session->currentRoom() : nullptr;
+  QStringList zones;
+  if (start && !destZone.isEmpty() && destZone != start->zone) {
+    // Collapse the room route into the sequence of zones it passes through
+    zones << start->zone;
+    std::shared_ptr<MapSearch> search = map->search();
+    for (int roomId : search ? search->findRoute(start->id, destZone) : QList<int>()) {
+      const MapRoom* room = map->room(roomId);
+      if (room && room->zone != zones.last()) {
+        zones << room->zone;
+      }
+    }
+    if (zones.last() != destZone) {
+      zones.clear();
+    }
+  }
+  if (zones != world->route()) {
+    world->setRoute(zones);
+    view->update();
+  }
+}
+
 void MapViewer::repositionHeader()
 {
   if (mapType == MiniMap) {
@@ -331,8 +536,15 @@ void MapViewer::setSession(GaloshSession* sess)
   if (sess == session) {
     return;
   }
+  showWorld(false);
   if (session) {
     QObject::disconnect(session, 0, this, 0);
+    if (map) {
+      QObject::disconnect(map, 0, this, 0);
+    }
+    if (mapLayout) {
+      QObject::disconnect(mapLayout, 0, this, 0);
+    }
   }
   session = sess;
   if (session) {
@@ -341,7 +553,11 @@ void MapViewer::setSession(GaloshSession* sess)
     }
 
     map = session->map();
+    QObject::connect(map, SIGNAL(roomUpdated(int)), this, SLOT(roomUpdated(int)));
+    QObject::connect(map, SIGNAL(searchUpdated()), this, SLOT(searchUpdated()));
+    QObject::connect(map, SIGNAL(routingChanged()), this, SLOT(routingChanged()));
     mapLayout = map->layout();
+    QObject::connect(mapLayout, SIGNAL(layoutUpdated()), this, SLOT(layoutUpdated()));
     view->setMap(mapLayout);
   } else {
     map = nullptr;
@@ -349,5 +565,6 @@ void MapViewer::setSession(GaloshSession* sess)
     view->setMap(nullptr);
   }
   reload();
+  showDistances(distanceButton->isChecked());
   setCurrentRoom();
 }
@@ -6,9 +6,13 @@
 #include <memory>
 class QScrollArea;
 class QComboBox;
+class QToolButton;
+class QAction;
 class MapManager;
 class MapWidget;
 class MapLayout;
+class WorldLayout;
+class DistanceField;
 class ExploreHistory;
 class GaloshSession;
 
@@ -32,6 +36,9 @@ public slots:
   void setZoom(double level);
   void zoomIn();
   void zoomOut();
+  void showWorld(bool on);
+  void showDistances(bool on);
+  void setDistanceModel(QAction* action);
 
   void setCurrentRoom(int roomId = -1);
 
@@ -40,6 +47,10 @@ signals:
 
 protected slots:
   void repositionHeader();
+  void layoutUpdated();
+  void roomUpdated(int roomId);
+  void searchUpdated();
+  void routingChanged();
 
 protected:
   // TODO: explore on double-click
@@ -50,6 +61,7 @@ protected:
 
 private:
   friend class MapWidget;
+  void highlightRoute(const QString& zone);
 
   QPointer<GaloshSession> session;
   MapManager* map;
@@ -58,6 +70,10 @@ private:
   QScrollArea* scrollArea;
   MapWidget* view;
   QComboBox* zone;
+  QToolButton* worldButton;
+  QToolButton* distanceButton;
+  std::unique_ptr<DistanceField> distances;
+  bool uniformDistances;
   MapType mapType;
 };
 
@@ -79,8 +79,8 @@ QSet<int> MapRoom::exitRooms() const
   return rooms;
 }
 
-MapZone::MapZone(MapManager* map, const QString& name)
-: map(map), name(name)
+MapZone::MapZone(MapManager* map, const QString& name, int index)
+: map(map), name(name), index(index)
 {
   // initializers only
 }
@@ -43,9 +43,10 @@ private:
   MapManager* map;
 
 public:
-  MapZone(MapManager* map, const QString& name);
+  MapZone(MapManager* map, const QString& name, int index);
 
   ZoneID name;
+  int index;
   QSet<int> roomIds;
   QMap<ZoneID, QSet<int>> exits;
 
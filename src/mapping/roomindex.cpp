@@ -0,0 +1,201 @@
+#include "roomindex.h"
+#include "mapzone.h"
+#include "trigrams.h"
+#include <algorithm>
+
+uint RoomIndex::signature(const QString& name, const QString& description, const QStringList& exits)
+{
+  QStringList sortedExits = exits;
+  sortedExits.sort();
+  uint seed = qHash(name.simplified().toLower());
+  seed = qHash(description.simplified(), seed);
+  return qHash(sortedExits.join(' '), seed);
+}
+
+void RoomIndex::clear()
+{
+  nameIndex.clear();
+  textIndex.clear();
+  indexed.clear();
+  fullSignatures.clear();
+  briefSignatures.clear();
+  roomSignatures.clear();
+  built = false;
+}
+
+void RoomIndex::rebuild(const QMap<int, MapRoom>& rooms)
+{
+  clear();
+  for (const MapRoom& room : rooms) {
+    // Rooms come out of the map in ID order, so the posting lists stay sorted
+    addRoom(room.id, room.name, room.description);
+    updateSignatures(&room);
+  }
+  built = true;
+}
+
+void RoomIndex::updateRoom(const MapRoom* room)
+{
+  if (!built) {
+    return;
+  }
+  updateSignatures(room);
+  auto iter = indexed.constFind(room->id);
+  if (iter != indexed.constEnd()) {
+    if (iter->first == room->name && iter->second == room->description) {
+      return;
+    }
+    removeText(room->id);
+  }
+  addRoom(room->id, room->name, room->description);
+}
+
+void RoomIndex::updateSignatures(const MapRoom* room)
+{
+  QStringList exits = room->exits.keys();
+  QPair<uint, uint> signatures(signature(room->name, room->description, exits), signature(room->name, QString(), exits));
+  auto iter = roomSignatures.constFind(room->id);
+  if (iter != roomSignatures.constEnd()) {
+    if (*iter == signatures) {
+      return;
+    }
+    removeSignatures(room->id);
+  }
+  if (!room->description.isEmpty()) {
+    fullSignatures.insert(signatures.first, room->id);
+  }
+  briefSignatures.insert(signatures.second, room->id);
+  roomSignatures[room->id] = signatures;
+}
+
+void RoomIndex::removeSignatures(int roomId)
+{
+  auto iter = roomSignatures.find(roomId);
+  if (iter == roomSignatures.end()) {
+    return;
+  }
+  fullSignatures.remove(iter->first, roomId);
+  briefSignatures.remove(iter->second, roomId);
+  roomSignatures.erase(iter);
+}
+
+QList<int> RoomIndex::matchingRooms(const QString& name, const QString& description, const QStringList& exits) const
+{
+  QList<int> result;
+  if (description.isEmpty()) {
+    result = briefSignatures.values(signature(name, QString(), exits));
+  } else {
+    result = fullSignatures.values(signature(name, description, exits));
+  }
+  // Weed out hash collisions
+  QString normalized = name.simplified().toLower();
+  for (int i = result.length() - 1; i >= 0; --i) {
+    auto text = indexed.constFind(result[i]);
+    if (text == indexed.constEnd() || text->first.simplified().toLower() != normalized) {
+      result.removeAt(i);
+    }
+  }
+  return result;
+}
+
+void RoomIndex::removeRoom(int roomId)
+{
+  removeSignatures(roomId);
+  removeText(roomId);
+}
+
+void RoomIndex::removeText(int roomId)
+{
+  auto iter = indexed.find(roomId);
+  if (iter == indexed.end()) {
+    return;
+  }
+  QSet<quint64> nameKeys = trigrams(iter->first);
+  QSet<quint64> textKeys = nameKeys + trigrams(iter->second);
+  for (quint64 key : nameKeys) {
+    removePosting(nameIndex, key, roomId);
+  }
+  for (quint64 key : textKeys) {
+    removePosting(textIndex, key, roomId);
+  }
+  indexed.erase(iter);
+}
+
+void RoomIndex::addRoom(int roomId, const QString& name, const QString& description)
+{
+  QSet<quint64> nameKeys = trigrams(name);
+  QSet<quint64> textKeys = nameKeys + trigrams(description);
+  for (quint64 key : nameKeys) {
+    addPosting(nameIndex, key, roomId);
+  }
+  for (quint64 key : textKeys) {
+    addPosting(textIndex, key, roomId);
+  }
+  indexed[roomId] = qMakePair(name, description);
+}
+
+void RoomIndex::addPosting(Postings& postings, quint64 key, int roomId)
+{
+  QVector<int>& list = postings[key];
+  if (list.isEmpty() || list.last() < roomId) {
+    list << roomId;
+    return;
+  }
+  auto pos = std::lower_bound(list.begin(), list.end(), roomId);
+  if (*pos != roomId) {
+    list.insert(pos, roomId);
+  }
+}
+
+void RoomIndex::removePosting(Postings& postings, quint64 key, int roomId)
+{
+  auto iter = postings.find(key);
+  if (iter == postings.end()) {
+    return;
+  }
+  auto pos = std::lower_bound(iter->begin(), iter->end(), roomId);
+  if (pos != iter->end() && *pos == roomId) {
+    iter->erase(pos);
+  }
+  if (iter->isEmpty()) {
+    postings.erase(iter);
+  }
+}
+
+bool RoomIndex::candidates(const QStringList& patterns, bool namesOnly, QVector<int>* result) const
+{
+  QSet<quint64> keys;
+  for (const QString& pattern : patterns) {
+    for (const QString& literal : requiredLiterals(pattern)) {
+      keys += trigrams(literal);
+    }
+  }
+  if (keys.isEmpty()) {
+    return false;
+  }
+
+  const Postings& postings = namesOnly ? nameIndex : textIndex;
+  QList<const QVector<int>*> lists;
+  for (quint64 key : keys) {
+    auto iter = postings.constFind(key);
+    if (iter == postings.constEnd()) {
+      result->clear();
+      return true;
+    }
+    lists << &*iter;
+  }
+  std::sort(lists.begin(), lists.end(), [](const QVector<int>* lhs, const QVector<int>* rhs) { return lhs->size() < rhs->size(); });
+
+  // Intersect starting from the shortest list
+  *result = *lists.first();
+  QVector<int> next;
+  for (const QVector<int>* list : lists.mid(1)) {
+    if (result->isEmpty()) {
+      break;
+    }
+    next.clear();
+    std::set_intersection(result->begin(), result->end(), list->begin(), list->end(), std::back_inserter(next));
+    std::swap(*result, next);
+  }
+  return true;
+}
@@ -0,0 +1,55 @@
+#ifndef GALOSH_ROOMINDEX_H
+#define GALOSH_ROOMINDEX_H
+
+#include <QHash>
+#include <QMap>
+#include <QPair>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+class MapRoom;
+
+// Trigram index over room names and descriptions, used to narrow down the
+// rooms that need to be checked against a search pattern. Also keeps a hash
+// of each room's name, description and exits for recognizing rooms.
+class RoomIndex
+{
+public:
+  static uint signature(const QString& name, const QString& description, const QStringList& exits);
+
+  inline bool isBuilt() const { return built; }
+  void clear();
+  void rebuild(const QMap<int, MapRoom>& rooms);
+  void updateRoom(const MapRoom* room);
+  void removeRoom(int roomId);
+
+  // Returns false if the patterns don't contain enough literal text to use the index.
+  // Otherwise, the result contains the sorted IDs of the rooms that might match.
+  bool candidates(const QStringList& patterns, bool namesOnly, QVector<int>* result) const;
+
+  // Rooms that look the same as the given capture. If the description is
+  // empty, only the name and exits are compared.
+  QList<int> matchingRooms(const QString& name, const QString& description, const QStringList& exits) const;
+
+private:
+  using Postings = QHash<quint64, QVector<int>>;
+
+  static void addPosting(Postings& postings, quint64 key, int roomId);
+  static void removePosting(Postings& postings, quint64 key, int roomId);
+  void addRoom(int roomId, const QString& name, const QString& description);
+  void removeText(int roomId);
+  void updateSignatures(const MapRoom* room);
+  void removeSignatures(int roomId);
+
+  Postings nameIndex;
+  Postings textIndex;
+  // The text that was indexed for each room, so it can be removed again
+  QHash<int, QPair<QString, QString>> indexed;
+  QMultiHash<uint, int> fullSignatures;
+  QMultiHash<uint, int> briefSignatures;
+  QHash<int, QPair<uint, uint>> roomSignatures;
+  bool built = false;
+};
+
+#endif
@@ -0,0 +1,297 @@
+#include "worldlayout.h"
+#include "mapmanager.h"
+#include "mapzone.h"
+#include <QPainter>
+#include <QCryptographicHash>
+#include <QSet>
+#include <algorithm>
+#include <cmath>
+
+// Layout units match MapLayout's so the same zoom levels work for both
+static constexpr double LINK_LENGTH = 16;
+static constexpr double NODE_SPACING = 4;
+static constexpr double GRAVITY = 0.02;
+static constexpr double MARGIN = 8;
+// Labels are drawn at a fixed pixel size
+static constexpr int LABEL_WIDTH = 120;
+static constexpr int LABEL_HEIGHT = 12;
+// Below DOT_ZOOM nodes are drawn without outlines; labels need LABEL_ZOOM
+static constexpr double DOT_ZOOM = 1;
+static constexpr double LABEL_ZOOM = 3;
+
+static const QColor linkColor(96, 96, 96);
+static const QColor nodeColor(160, 160, 160);
+static const QColor currentColor(128, 255, 255);
+static const QColor routeColor(255, 192, 0);
+
+WorldLayout::WorldLayout(MapManager* map)
+: map(map)
+{
+  // initializers only
+}
+
+void WorldLayout::update()
+{
+  QStringList names = map->zoneNames();
+  QHash<QString, int> index;
+  for (int i = 0; i < names.size(); i++) {
+    index[names[i]] = i;
+  }
+
+  QSet<QPair<int, int>> edgeSet;
+  QVector<double> radii(names.size());
+  for (int i = 0; i < names.size(); i++) {
+    const MapZone* zone = map->zone(names[i]);
+    if (!zone) {
+      continue;
+    }
+    radii[i] = 1 + std::sqrt(double(zone->roomIds.size())) / 4;
+    for (auto iter = zone->exits.begin(); iter != zone->exits.end(); ++iter) {
+      int j = index.value(iter.key(), -1);
+      if (j >= 0 && j != i) {
+        edgeSet << qMakePair(qMin(i, j), qMax(i, j));
+      }
+    }
+  }
+  QVector<QPair<int, int>> edges(edgeSet.begin(), edgeSet.end());
+  std::sort(edges.begin(), edges.end());
+
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+  for (const QString& name : names) {
+    hash.addData(name.toUtf8());
+    hash.addData("\0", 1);
+  }
+  for (const auto& edge : edges) {
+    hash.addData(reinterpret_cast<const char*>(&edge.first), sizeof(int));
+    hash.addData(reinterpret_cast<const char*>(&edge.second), sizeof(int));
+  }
+  QByteArray newSignature = hash.result();
+
+  if (newSignature != signature) {
+    signature = newSignature;
+    QVector<Node> previous = nodes;
+    QHash<QString, int> previousIndex = nodeIndex;
+
+    QVector<QVector<int>> neighbours(names.size());
+    for (const auto& edge : edges) {
+      neighbours[edge.first] << edge.second;
+      neighbours[edge.second] << edge.first;
+    }
+
+    // Keep the positions of known zones so the overview doesn't jump around
+    nodes.clear();
+    nodes.reserve(names.size());
+    QVector<bool> placed(names.size(), false);
+    int known = 0;
+    for (int i = 0; i < names.size(); i++) {
+      Node node{ names[i], QPointF(), radii[i] };
+      int old = previousIndex.value(names[i], -1);
+      if (old >= 0) {
+        node.pos = previous[old].pos;
+        placed[i] = true;
+        ++known;
+      }
+      nodes << node;
+    }
+    for (int i = 0; i < nodes.size(); i++) {
+      if (placed[i]) {
+        continue;
+      }
+      QPointF sum;
+      int count = 0;
+      for (int j : neighbours[i]) {
+        if (placed[j]) {
+          sum += nodes[j].pos;
+          ++count;
+        }
+      }
+      // New zones start next to their neighbours, or on a spiral if they have none
+      double angle = i * 2.39996;
+      if (count) {
+        nodes[i].pos = sum / count + QPointF(std::cos(angle), std::sin(angle)) * LINK_LENGTH / 2;
+      } else {
+        nodes[i].pos = QPointF(std::cos(angle), std::sin(angle)) * LINK_LENGTH * std::sqrt(double(i + 1));
+      }
+    }
+
+    nodeIndex = index;
+    links = edges;
+    if (known * 2 > nodes.size()) {
+      relax(60, LINK_LENGTH / 2);
+    } else {
+      relax(300, LINK_LENGTH * 2);
+    }
+  } else {
+    for (int i = 0; i < nodes.size(); i++) {
+      nodes[i].radius = radii[i];
+    }
+  }
+
+  boundingBox = QRectF();
+  for (const Node& node : nodes) {
+    boundingBox |= QRectF(node.pos.x() - node.radius, node.pos.y() - node.radius, node.radius * 2, node.radius * 2);
+  }
+  boundingBox.adjust(-MARGIN, -MARGIN, MARGIN, MARGIN);
+}
+
+void WorldLayout::relax(int iterations, double temperature)
+{
+  // Fruchterman-Reingold: nodes repel each other, links pull their ends
+  // together, and a weak pull toward the origin keeps disconnected parts close.
+  int count = nodes.size();
+  double cooling = std::pow(0.05, 1.0 / iterations);
+  QVector<QPointF> disp(count);
+  for (int iter = 0; iter < iterations; iter++) {
+    std::fill(disp.begin(), disp.end(), QPointF());
+    for (int i = 0; i < count; i++) {
+      for (int j = i + 1; j < count; j++) {
+        QPointF delta = nodes[i].pos - nodes[j].pos;
+        double dist = std::hypot(delta.x(), delta.y());
+        if (dist < 0.01) {
+          delta = QPointF(i - j, j - i) * 0.01;
+          dist = std::hypot(delta.x(), delta.y());
+        }
+        double force = LINK_LENGTH * LINK_LENGTH / dist;
+        if (dist < nodes[i].radius + nodes[j].radius + NODE_SPACING) {
+          force *= 4;
+        }
+        delta *= force / dist;
+        disp[i] += delta;
+        disp[j] -= delta;
+      }
+    }
+    for (const auto& link : links) {
+      QPointF delta = nodes[link.first].pos - nodes[link.second].pos;
+      double dist = std::hypot(delta.x(), delta.y());
+      delta *= dist / LINK_LENGTH;
+      disp[link.first] -= delta;
+      disp[link.second] += delta;
+    }
+    for (int i = 0; i < count; i++) {
+      disp[i] -= nodes[i].pos * GRAVITY;
+      double len = std::hypot(disp[i].x(), disp[i].y());
+      if (len > 0) {
+        nodes[i].pos += disp[i] * (qMin(len, temperature) / len);
+      }
+    }
+    temperature *= cooling;
+  }
+}
+
+QSize WorldLayout::displaySize() const
+{
+  return boundingBox.size().toSize();
+}
+
+void WorldLayout::paint(QPainter* painter, const QRect& exposed, double zoom) const
+{
+  static QFont font = [] {
+    QFont f("Sans");
+    f.setPixelSize(9);
+    return f;
+  }();
+
+  QRectF visible(QPointF(exposed.topLeft()) / zoom, QSizeF(exposed.size()) / zoom);
+  visible.translate(boundingBox.topLeft());
+
+  painter->save();
+  painter->setRenderHint(QPainter::Antialiasing, zoom >= LABEL_ZOOM);
+  painter->scale(zoom, zoom);
+  painter->translate(-boundingBox.topLeft());
+
+  QPen linkPen(linkColor, 1);
+  linkPen.setCosmetic(true);
+  painter->setPen(linkPen);
+  for (const auto& link : links) {
+    QPointF p1 = nodes[link.first].pos, p2 = nodes[link.second].pos;
+    if (QRectF(p1, p2).normalized().adjusted(-1, -1, 1, 1).intersects(visible)) {
+      painter->drawLine(p1, p2);
+    }
+  }
+
+  QSet<int> onRoute;
+  if (!routeZones.isEmpty()) {
+    QPen routePen(routeColor, 3);
+    routePen.setCosmetic(true);
+    painter->setPen(routePen);
+    int last = -1;
+    for (const QString& zone : routeZones) {
+      int node = nodeIndex.value(zone, -1);
+      if (node < 0) {
+        continue;
+      }
+      if (last >= 0) {
+        painter->drawLine(nodes[last].pos, nodes[node].pos);
+      }
+      onRoute << node;
+      last = node;
+    }
+  }
+
+  bool outline = zoom >= DOT_ZOOM;
+  QPen nodePen(Qt::black, 1);
+  nodePen.setCosmetic(true);
+  painter->setPen(outline ? nodePen : QPen(Qt::NoPen));
+  QVector<int> visibleNodes;
+  for (int i = 0; i < nodes.size(); i++) {
+    const Node& node = nodes[i];
+    QRectF rect(node.pos.x() - node.radius, node.pos.y() - node.radius, node.radius * 2, node.radius * 2);
+    if (!visible.intersects(rect.adjusted(-LABEL_WIDTH / 2.0 / zoom, 0, LABEL_WIDTH / 2.0 / zoom, LABEL_HEIGHT / zoom))) {
+      continue;
+    }
+    visibleNodes << i;
+    if (node.zone == currentZone) {
+      painter->setBrush(currentColor);
+    } else if (onRoute.contains(i)) {
+      painter->setBrush(routeColor);
+    } else {
+      painter->setBrush(nodeColor);
+    }
+    if (outline) {
+      painter->drawEllipse(rect);
+    } else {
+      painter->drawRect(rect);
+    }
+  }
+  painter->restore();
+
+  if (zoom >= LABEL_ZOOM) {
+    painter->save();
+    painter->setFont(font);
+    painter->setPen(Qt::white);
+    for (int i : visibleNodes) {
+      const Node& node = nodes[i];
+      QPointF anchor = (node.pos + QPointF(0, node.radius) - boundingBox.topLeft()) * zoom;
+      QRectF labelRect(anchor.x() - LABEL_WIDTH / 2, anchor.y() + 1, LABEL_WIDTH, LABEL_HEIGHT);
+      painter->drawText(labelRect, Qt::AlignHCenter | Qt::AlignTop | Qt::TextSingleLine, node.zone);
+    }
+    painter->restore();
+  }
+}
+
+QString WorldLayout::zoneAt(const QPointF& pt) const
+{
+  QPointF pos = pt + boundingBox.topLeft();
+  for (const Node& node : nodes) {
+    QPointF delta = pos - node.pos;
+    if (std::hypot(delta.x(), delta.y()) <= node.radius + 2) {
+      return node.zone;
+    }
+  }
+  return QString();
+}
+
+QRectF WorldLayout::zonePos(const QString& zone) const
+{
+  int i = nodeIndex.value(zone, -1);
+  if (i < 0) {
+    return QRectF();
+  }
+  const Node& node = nodes[i];
+  return QRectF(node.pos.x() - node.radius, node.pos.y() - node.radius, node.radius * 2, node.radius * 2).translated(-boundingBox.topLeft());
+}
+
+void WorldLayout::setRoute(const QStringList& zones)
+{
+  routeZones = zones;
+}
@@ -0,0 +1,57 @@
+#ifndef GALOSH_WORLDLAYOUT_H
+#define GALOSH_WORLDLAYOUT_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QPair>
+#include <QPointF>
+#include <QRectF>
+#include <QSize>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+class QPainter;
+class MapManager;
+
+// Overview of the whole map with one node per zone, placed by a force-directed
+// layout over the exits between zones. The placement is kept until the set of
+// zones or the links between them change.
+class WorldLayout
+{
+public:
+  WorldLayout(MapManager* map);
+
+  // Recomputes the placement if the zone graph has changed since the last call
+  void update();
+
+  QSize displaySize() const;
+  // Paints the exposed part of the overview; labels are only drawn when zoomed in
+  void paint(QPainter* painter, const QRect& exposed, double zoom) const;
+
+  QString zoneAt(const QPointF& pt) const;
+  QRectF zonePos(const QString& zone) const;
+
+  // Highlights a path through the given zones, in order
+  void setRoute(const QStringList& zones);
+  inline const QStringList& route() const { return routeZones; }
+  QString currentZone;
+
+private:
+  struct Node {
+    QString zone;
+    QPointF pos;
+    double radius;
+  };
+
+  void relax(int iterations, double temperature);
+
+  MapManager* map;
+  QByteArray signature;
+  QVector<Node> nodes;
+  QHash<QString, int> nodeIndex;
+  QVector<QPair<int, int>> links;
+  QRectF boundingBox;
+  QStringList routeZones;
+};
+
+#endif
@@ -19,7 +19,7 @@ static QString cleanHost(const QString& host)
 }
 
 ServerProfile::ServerProfile(const QString& rawHost)
-: host(cleanHost(rawHost))
+: host(cleanHost(rawHost)), commandRate(0), commandBurst(1), batchCommands(true)
 {
   QString mapFileName, itemsFileName;
   if (rawHost.endsWith(".galosh")) {
@@ -36,6 +36,15 @@ ServerProfile::ServerProfile(const QString& rawHost)
   QSettings settings;
   settings.beginGroup("Certificates");
   certificateHash = settings.value(host).toString();
+  settings.endGroup();
+
+  settings.beginGroup("RateLimits");
+  QStringList limits = settings.value(host).toString().split(' ', Qt::SkipEmptyParts);
+  if (limits.length() == 3) {
+    commandRate = qMax(limits[0].toDouble(), 0.0);
+    commandBurst = qMax(limits[1].toInt(), 1);
+    batchCommands = limits[2].toInt();
+  }
 }
 
 void ServerProfile::save()
@@ -47,4 +56,12 @@ void ServerProfile::save()
   } else {
     settings.setValue(host, certificateHash);
   }
+  settings.endGroup();
+
+  settings.beginGroup("RateLimits");
+  if (commandRate <= 0 && commandBurst <= 1 && batchCommands) {
+    settings.remove(host);
+  } else {
+    settings.setValue(host, QStringLiteral("%1 %2 %3").arg(commandRate).arg(commandBurst).arg(int(batchCommands)));
+  }
 }
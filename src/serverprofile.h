@@ -14,6 +14,12 @@ public:
   ItemDatabase itemDB;
   QString certificateHash;
 
+  // Outgoing command pacing; a rate of 0 sends commands as
+  // soon as the event loop runs, or immediately if batching is off
+  double commandRate;
+  int commandBurst;
+  bool batchCommands;
+
   void save();
 };
 
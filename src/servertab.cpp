@@ -1,6 +1,7 @@
 #include "servertab.h"
 #include "msspview.h"
 #include "userprofile.h"
+#include "serverprofile.h"
 #include <QSettings>
 #include <QFormLayout>
 #include <QBoxLayout>
@@ -11,6 +12,7 @@
 #include <QPushButton>
 #include <QButtonGroup>
 #include <QIntValidator>
+#include <QDoubleValidator>
 
 static const char* defaultLoginPrompt = "By what name do you wish to be known?";
 static const char* defaultPasswordPrompt = "Password:";
@@ -56,9 +58,21 @@ ServerTab::ServerTab(QWidget* parent)
 
   lServer->addRow("Us&ername prompt:", loginPrompt = new QLineEdit(defaultLoginPrompt, this));
   lServer->addRow("P&assword prompt:", passwordPrompt = new QLineEdit(defaultPasswordPrompt, this));
+  lServer->addRow(horizontalLine(this));
+
+  lServer->addRow("Speedwalk win&dow:", speedwalkWindow = new QLineEdit("1", this));
+  lServer->addRow("Commands per se&cond:", commandRate = new QLineEdit("0", this));
+  lServer->addRow("Burst si&ze:", commandBurst = new QLineEdit("1", this));
+  lServer->addRow("", batchCommands = new QCheckBox("Send &batched commands", this));
   setMinimumWidth(400);
 
   port->setValidator(new QIntValidator(1, 65535, port));
+  speedwalkWindow->setValidator(new QIntValidator(1, 99, speedwalkWindow));
+  speedwalkWindow->setToolTip("The number of steps to send before the first one arrives. Requires GMCP room IDs.");
+  commandRate->setValidator(new QDoubleValidator(0, 1000, 2, commandRate));
+  commandRate->setToolTip("The maximum sustained rate of outgoing commands. 0 sends commands immediately.");
+  commandBurst->setValidator(new QIntValidator(1, 999, commandBurst));
+  commandBurst->setToolTip("The number of commands that may be sent at once before pacing begins.");
   password->setEchoMode(QLineEdit::Password);
 
   autoConnectMarkDirty();
@@ -98,6 +112,10 @@ void ServerTab::newProfile()
   password->clear();
   loginPrompt->setText(defaultLoginPrompt);
   passwordPrompt->setText(defaultPasswordPrompt);
+  speedwalkWindow->setText("1");
+  commandRate->setText("0");
+  commandBurst->setText("1");
+  batchCommands->setChecked(true);
 
   name->setFocus();
 }
@@ -119,6 +137,10 @@ void ServerTab::load(UserProfile* profile)
   }
   username->setText(profile->username);
   password->setText(profile->password);
+  speedwalkWindow->setText(QString::number(profile->speedwalkWindow));
+  commandRate->setText(QString::number(profile->serverProfile->commandRate));
+  commandBurst->setText(QString::number(profile->serverProfile->commandBurst));
+  batchCommands->setChecked(profile->serverProfile->batchCommands);
 
   TriggerDefinition* usernameTrigger = profile->triggers.findTrigger(TriggerManager::UsernameId);
   loginPrompt->setText(usernameTrigger ? TriggerDefinition::cleanPattern(usernameTrigger->pattern.pattern()) : "");
@@ -142,6 +164,7 @@ bool ServerTab::save(UserProfile* profile)
   }
   profile->username = username->text().trimmed();
   profile->password = password->text();
+  profile->speedwalkWindow = qMax(speedwalkWindow->text().toInt(), 1);
 
   TriggerDefinition* usernameTrigger = profile->triggers.findTrigger(TriggerManager::UsernameId, true);
   usernameTrigger->pattern.setPattern(loginPrompt->text().trimmed());
@@ -156,5 +179,13 @@ bool ServerTab::save(UserProfile* profile)
 
   profile->save();
 
+  // Rate limits belong to the server, which depends on the saved host
+  profile->updateServerProfile();
+  ServerProfile* server = profile->serverProfile;
+  server->commandRate = qMax(commandRate->text().toDouble(), 0.0);
+  server->commandBurst = qMax(commandBurst->text().toInt(), 1);
+  server->batchCommands = batchCommands->isChecked();
+  server->save();
+
   return true;
 }
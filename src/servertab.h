@@ -38,6 +38,10 @@ private:
   QLineEdit* password;
   QLineEdit* loginPrompt;
   QLineEdit* passwordPrompt;
+  QLineEdit* speedwalkWindow;
+  QLineEdit* commandRate;
+  QLineEdit* commandBurst;
+  QCheckBox* batchCommands;
 };
 
 #endif
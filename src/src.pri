@@ -10,10 +10,11 @@ CLASSES += commandline multicommandline dropdowndelegate
 
 # models
 CLASSES += userprofile serverprofile
-CLASSES += triggermanager infomodel itemdatabase
+CLASSES += triggermanager infomodel itemdatabase itemindex itemkeys
+CLASSES += itemstore completionindex trigrams
 
 # networking
-CLASSES += telnetsocket
+CLASSES += telnetsocket commandscheduler
 
 HEADERS += $$PWD/algorithms.h $$PWD/refable.h $$PWD/settingsgroup.h
 SOURCES += $$PWD/main.cpp
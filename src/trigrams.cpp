@@ -0,0 +1,71 @@
+#include "trigrams.h"
+
+QSet<quint64> trigrams(const QString& text)
+{
+  QSet<quint64> keys;
+  QString lower = text.toLower();
+  for (int i = 2; i < lower.length(); i++) {
+    keys << ((quint64(lower[i - 2].unicode()) << 32) | (quint64(lower[i - 1].unicode()) << 16) | lower[i].unicode());
+  }
+  return keys;
+}
+
+QStringList requiredLiterals(const QString& pattern)
+{
+  // Alternation and groups can make any part of the pattern optional
+  if (pattern.contains('|') || pattern.contains('(')) {
+    return {};
+  }
+
+  QStringList literals;
+  QString run;
+  auto endRun = [&]{
+    if (run.length() >= 3) {
+      literals << run;
+    }
+    run.clear();
+  };
+  for (int i = 0; i < pattern.length(); i++) {
+    QChar ch = pattern[i];
+    if (ch == '\\') {
+      if (i + 1 < pattern.length() && !pattern[i + 1].isLetterOrNumber()) {
+        run += pattern[++i];
+      } else {
+        // Character class escapes like \w or \d
+        ++i;
+        endRun();
+      }
+    } else if (ch == '*' || ch == '?' || ch == '{') {
+      // The quantifier makes the previous character optional
+      run.chop(1);
+      endRun();
+      if (ch == '{') {
+        while (i < pattern.length() && pattern[i] != '}') {
+          ++i;
+        }
+      }
+    } else if (ch == '+') {
+      endRun();
+    } else if (ch == '[') {
+      endRun();
+      ++i;
+      if (i < pattern.length() && pattern[i] == '^') {
+        ++i;
+      }
+      // A leading ] is part of the set
+      ++i;
+      while (i < pattern.length() && pattern[i] != ']') {
+        if (pattern[i] == '\\') {
+          ++i;
+        }
+        ++i;
+      }
+    } else if (ch == '.' || ch == '^' || ch == '$') {
+      endRun();
+    } else {
+      run += ch;
+    }
+  }
+  endRun();
+  return literals;
+}
@@ -0,0 +1,16 @@
+#ifndef GALOSH_TRIGRAMS_H
+#define GALOSH_TRIGRAMS_H
+
+#include <QSet>
+#include <QString>
+#include <QStringList>
+
+// Helpers for trigram indexes, shared by the room and item name indexes
+
+// Case-insensitive trigram keys of the text
+QSet<quint64> trigrams(const QString& text);
+
+// Runs of literal text that any match of the regular expression must contain
+QStringList requiredLiterals(const QString& pattern);
+
+#endif
@@ -30,7 +30,7 @@ void UserProfile::setDefaultFont(const QFont& font)
 }
 
 UserProfile::UserProfile(const QString& profilePath)
-: profilePath(profilePath)
+: profilePath(profilePath), speedwalkWindow(1)
 {
   reload();
 }
@@ -82,6 +82,7 @@ void UserProfile::reload()
     username = settings.value("username").toString();
     password = settings.value("password").toString();
     lastRoomId = settings.value("lastRoom", -1).toInt();
+    speedwalkWindow = qMax(settings.value("speedwalkWindow", 1).toInt(), 1);
   }
 
   {
@@ -97,6 +98,7 @@ void UserProfile::reload()
   }
 
   commandDefs.clear();
+  commandTemplates.clear();
   for (const QString& group : settings.childGroups()) {
     if (group.startsWith("Command-")) {
       SettingsGroup sg(&settings, group);
@@ -104,13 +106,13 @@ void UserProfile::reload()
       for (const QString& key : settings.childKeys()) {
         actions[key.toInt()] = settings.value(key).toString();
       }
-      commandDefs[group.section('-', 1)] = actions.values();
+      setCustomCommand(group.section('-', 1), actions.values());
     }
   }
 
   triggers.loadProfile(profilePath);
 
-  serverProfile = getServerProfile(host.isEmpty() ? profilePath : host);
+  updateServerProfile();
 }
 
 bool UserProfile::save()
@@ -128,6 +130,13 @@ bool UserProfile::save()
   return settings.status() != QSettings::NoError;
 }
 
+void UserProfile::updateServerProfile()
+{
+  // Only the host is saved for connection profiles, so match what reload() would read back
+  QString key = command.isEmpty() ? host : QString();
+  serverProfile = getServerProfile(key.isEmpty() ? profilePath : key);
+}
+
 void UserProfile::saveProfileSection(QSettings& settings)
 {
   SettingsGroup sg(&settings, "Profile");
@@ -149,6 +158,11 @@ void UserProfile::saveProfileSection(QSettings& settings)
   }
   settings.setValue("username", username);
   settings.setValue("password", password);
+  if (speedwalkWindow > 1) {
+    settings.setValue("speedwalkWindow", speedwalkWindow);
+  } else {
+    settings.remove("speedwalkWindow");
+  }
 
   TriggerDefinition* usernameTrigger = triggers.findTrigger(TriggerManager::UsernameId);
   if (usernameTrigger) {
@@ -232,12 +246,23 @@ QStringList UserProfile::customCommand(const QString& name) const
   return commandDefs.value(name);
 }
 
+QList<CommandTemplate> UserProfile::customCommandTemplates(const QString& name) const
+{
+  return commandTemplates.value(name);
+}
+
 void UserProfile::setCustomCommand(const QString& name, const QStringList& actions)
 {
   if (actions.isEmpty()) {
     commandDefs.remove(name);
+    commandTemplates.remove(name);
   } else {
     commandDefs[name] = actions;
+    QList<CommandTemplate>& templates = commandTemplates[name];
+    templates.clear();
+    for (const QString& action : actions) {
+      templates << CommandTemplate(action);
+    }
   }
 }
 
@@ -8,6 +8,7 @@
 #include "explorehistory.h"
 #include "colorschemes.h"
 #include "itemdatabase.h"
+#include "commands/commandtemplate.h"
 class QSettings;
 class ServerProfile;
 
@@ -30,6 +31,7 @@ public:
   QString username;
   QString password;
   int lastRoomId;
+  int speedwalkWindow;
 
   QString colorScheme;
   QFont selectedFont;
@@ -46,6 +48,8 @@ public:
 
   void reload();
   bool save();
+  // Picks the server profile for the current host without reloading the file
+  void updateServerProfile();
 
   QStringList itemSets() const;
   ItemDatabase::EquipmentSet loadItemSet(const QString& name) const;
@@ -54,6 +58,7 @@ public:
 
   QStringList customCommands() const;
   QStringList customCommand(const QString& name) const;
+  QList<CommandTemplate> customCommandTemplates(const QString& name) const;
   void setCustomCommand(const QString& name, const QStringList& actions);
 
 private:
@@ -65,6 +70,7 @@ private:
   void saveCommandsSection(QSettings& settings);
 
   QMap<QString, QStringList> commandDefs;
+  QMap<QString, QList<CommandTemplate>> commandTemplates;
 };
 
 #endif